@@ -0,0 +1,65 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <atomic>
+
+// Atomic access to plain fields that are only shared between threads some
+// of the time, such as node child slots during concurrent inserts. Loads
+// acquire, stores release and compare-exchange does both, so whatever a
+// thread wrote before publishing an index is visible to whoever reads it.
+#if defined(__GNUC__) || defined(__clang__)
+
+template <typename T>
+inline T AtomicLoad(const T* address) {
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline void AtomicStore(T* address, T value) {
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+}
+
+// On failure expected receives the current value.
+template <typename T>
+inline bool AtomicCompareExchange(T* address, T& expected, T desired) {
+    return __atomic_compare_exchange_n(address, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline T AtomicFetchAdd(T* address, T value) {
+    return __atomic_fetch_add(address, value, __ATOMIC_ACQ_REL);
+}
+
+#else
+
+// std::atomic<T> of a lock-free T has T's size and layout on the other
+// supported compilers, so the field is accessed through one.
+template <typename T>
+inline std::atomic<T>* AsAtomic(const T* address) {
+    static_assert(sizeof(std::atomic<T>) == sizeof(T), "std::atomic<T> must have T's layout");
+    return reinterpret_cast<std::atomic<T>*>(const_cast<T*>(address));
+}
+
+template <typename T>
+inline T AtomicLoad(const T* address) {
+    return AsAtomic(address)->load(std::memory_order_acquire);
+}
+
+template <typename T>
+inline void AtomicStore(T* address, T value) {
+    AsAtomic(address)->store(value, std::memory_order_release);
+}
+
+template <typename T>
+inline bool AtomicCompareExchange(T* address, T& expected, T desired) {
+    return AsAtomic(address)->compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+template <typename T>
+inline T AtomicFetchAdd(T* address, T value) {
+    return AsAtomic(address)->fetch_add(value, std::memory_order_acq_rel);
+}
+
+#endif
+
+#endif
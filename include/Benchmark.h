@@ -0,0 +1,50 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Octree.h"
+#include "Terrain.h"
+
+// Benchmarks and self-checks run from the command line on the generated
+// terrain. They print their results to std::cout.
+
+// Marches a fixed set of camera rays through the octree in each NodeLayout,
+// feeding every node and color read through a simulated L1/L2/L3 cache, and
+// reports misses per ray next to the wall time. The octree is left in
+// breadth-first order.
+void RunLayoutBenchmark(SparseVoxelOctree& octree);
+
+// Times the CPU queries (Lookup, ForEachLeafInBox, FindGround and
+// FindNearest) on random points near the surface and reports the cost per
+// query.
+void RunQueryBenchmark(const SparseVoxelOctree& octree);
+
+// Converts the octree to a BrickOctree with 4^3 and 8^3 bricks and reports
+// memory use, conversion time, Lookup cost and ForEachVoxel time next to
+// the flat tree, along with any lookup that disagrees with it.
+void RunBrickBenchmark(const SparseVoxelOctree& octree);
+
+// Traces the layout benchmark's camera rays with Raycast, Raycast8 in
+// packets of eight neighbouring pixels, and the restart march the shader
+// uses, and reports rays per second and any disagreement between them.
+void RunRaycastBenchmark(const SparseVoxelOctree& octree);
+
+// Times layered noise stacks (plain fBm, ridged, domain warped, and the
+// terrain's own) through the run time getNoise and the compile time
+// getNoise<Stack>, reports nanoseconds per sample and per octave, and checks
+// that both give the same values.
+void RunNoiseBenchmark(const TerrainGenerator& terrain);
+
+// Stress test for concurrent inserts: the terrain plus random vegetation and
+// structures is inserted by threadCount threads at once, interleaved so they
+// fight over the same nodes, and compared with a serial Insert of the same
+// voxels. Returns true if every round matches node for node.
+bool RunConcurrentInsertCheck(const std::vector<Voxel>& terrain, int size, int maxDepth, int threadCount);
+
+// Check for published snapshots: this thread carves and fills spheres near
+// the surface and publishes after each edit, comparing the snapshot with the
+// live tree node for node, while threadCount - 1 readers pin snapshots and
+// look the same points up twice in each, which must agree. Reports how many
+// chunks each publish copied. Returns true if nothing differed.
+bool RunSnapshotCheck(SparseVoxelOctree& octree, int threadCount);
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef BRICK_OCTREE_H
+#define BRICK_OCTREE_H
+
+#include "Octree.h"
+#include <cstdint>
+#include <vector>
+
+// Hybrid octree: regular nodes down to a cut-off depth, dense bricks below.
+// A brick is the occupancy bitmask of a 4^3 or 8^3 block of voxels plus one
+// packed color per occupied voxel, stored in bit order; voxel (x, y, z) of a
+// brick is bit (z * side + y) * side + x. A node at the cut-off
+// depth is a leaf whose childIndices[0] holds its brick index; a leaf above
+// it (childIndices[0] == -1) is a solid region colored by its node color.
+class BrickOctree {
+public:
+    // brickLevels is 2 for 4^3 bricks or 3 for 8^3 bricks (clamped to 0-3
+    // and to the octree's depth).
+    BrickOctree(const SparseVoxelOctree& octree, int brickLevels);
+    bool Lookup(glm::ivec3 point, glm::vec4* color = nullptr) const;
+    // Calls visit(corner, color) for every occupied voxel, where corner is
+    // the voxel's minimum corner in octree coordinates. Inside bricks only
+    // set bits are visited, found with bit scans.
+    template <typename Visit>
+    void ForEachVoxel(Visit visit) const;
+    size_t VoxelCount() const { return m_brickColors.size(); }
+    size_t BrickCount() const { return m_colorOffsets.size(); }
+    const std::vector<FlattenedNode>& Nodes() const { return m_nodes; }
+    const std::vector<uint32_t>& Colors() const { return m_colors; }
+    // Bytes used by nodes, node colors, occupancy masks and brick colors.
+    size_t MemoryUsage() const;
+private:
+    int BitIndex(int x, int y, int z) const { return (z * m_brickSide + y) * m_brickSide + x; }
+    bool TestBit(int brick, int bit) const {
+        return (m_occupancy[brick * m_wordsPerBrick + (bit >> 6)] >> (bit & 63)) & 1;
+    }
+    // Index into m_brickColors of an occupied voxel: the brick's first color
+    // plus the number of set bits before it.
+    uint32_t ColorIndex(int brick, int bit) const;
+    static int CountTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#else
+        int count = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+    static int PopCount(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(bits);
+#else
+        int count = 0;
+        for (; bits; bits &= bits - 1)
+            count++;
+        return count;
+#endif
+    }
+    std::vector<FlattenedNode> m_nodes;
+    std::vector<uint32_t> m_colors;
+    std::vector<uint64_t> m_occupancy;     // m_wordsPerBrick words per brick
+    std::vector<uint32_t> m_colorOffsets;  // First brick color of each brick
+    std::vector<uint32_t> m_brickColors;   // Packed RGBA8, bit order within a brick
+    std::vector<int> m_halfSizes;
+    std::vector<int> m_localOffsets;       // Corner offset of local coordinate v inside a brick
+    int m_maxDepth;
+    int m_brickDepth;
+    int m_brickLevels;
+    int m_brickSide;
+    int m_wordsPerBrick;
+};
+
+template <typename Visit>
+void BrickOctree::ForEachVoxel(Visit visit) const {
+    struct Entry {
+        int node;
+        int depth;
+        glm::ivec3 position;
+    };
+    // Each level pops one node and pushes up to eight.
+    std::vector<Entry> stack(7 * m_maxDepth + 8);
+    int stackSize = 0;
+    stack[stackSize++] = {0, 0, glm::ivec3(0)};
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+        const FlattenedNode& node = m_nodes[entry.node];
+        if (node.IsLeaf) {
+            int brick = node.childIndices[0];
+            if (brick == -1) {
+                // Solid region above the brick depth: report the voxel grid
+                // it covers, so callers see the same voxels either way.
+                int side = 1 << (m_maxDepth - entry.depth);
+                for (int z = 0; z < side; z++)
+                    for (int y = 0; y < side; y++)
+                        for (int x = 0; x < side; x++) {
+                            glm::ivec3 corner = entry.position;
+                            int depth = entry.depth;
+                            // Walk the integer split of each axis down to the voxel.
+                            for (int level = side >> 1; level > 0; level >>= 1, depth++) {
+                                corner.x += (x & level) ? m_halfSizes[depth] : 0;
+                                corner.y += (y & level) ? m_halfSizes[depth] : 0;
+                                corner.z += (z & level) ? m_halfSizes[depth] : 0;
+                            }
+                            visit(corner, m_colors[entry.node]);
+                        }
+                continue;
+            }
+            const uint64_t* words = &m_occupancy[brick * m_wordsPerBrick];
+            uint32_t colorIndex = m_colorOffsets[brick];
+            for (int word = 0; word < m_wordsPerBrick; word++) {
+                for (uint64_t bits = words[word]; bits; bits &= bits - 1) {
+                    int bit = word * 64 + CountTrailingZeros(bits);
+                    int x = bit % m_brickSide;
+                    int y = (bit / m_brickSide) % m_brickSide;
+                    int z = bit / (m_brickSide * m_brickSide);
+                    glm::ivec3 corner = entry.position + glm::ivec3(m_localOffsets[x], m_localOffsets[y], m_localOffsets[z]);
+                    visit(corner, m_brickColors[colorIndex++]);
+                }
+            }
+            continue;
+        }
+        int half = m_halfSizes[entry.depth];
+        for (int octant = 7; octant >= 0; octant--) {
+            int child = node.childIndices[octant];
+            if (child == -1)
+                continue;
+            glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+            stack[stackSize++] = {child, entry.depth + 1, entry.position + offset * half};
+        }
+    }
+}
+
+#endif
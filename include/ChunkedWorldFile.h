@@ -0,0 +1,103 @@
+#ifndef CHUNKED_WORLD_FILE_H
+#define CHUNKED_WORLD_FILE_H
+
+#include "MappedFile.h"
+#include "Octree.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout: this header, the chunk index, then the compressed
+// records. The tree is cut at chunkDepth: the nodes above it form the top
+// record and each node at chunkDepth roots a chunk record holding its
+// subtree. A chunk's coordinate is the octant path down to it, one bit per
+// level on each axis, so chunks form a 2^chunkDepth grid.
+//
+// A record lists its nodes in pre-order as a flags byte, a child mask and,
+// in the chunks of a merged tree, one varint per child that is 0 for the
+// next node or the distance back to a node already listed; child indices
+// are otherwise implied by the order. Colors follow, each byte stored as the difference from the same
+// byte of the previous node. The record is then LZ compressed. In the top
+// record the children at chunkDepth aren't listed; they are the chunks.
+struct ChunkedWorldHeader {
+    char magic[8];         // "SVOCHUNK"
+    uint32_t version;
+    uint32_t headerSize;   // sizeof(ChunkedWorldHeader)
+    int32_t size;
+    int32_t maxDepth;
+    uint32_t seed;         // Terrain seed the world was generated from
+    uint32_t flags;        // MergedFlag
+    int32_t chunkDepth;
+    uint32_t chunkCount;
+    uint64_t indexOffset;  // Byte offsets from the start of the file
+    uint64_t topOffset;
+    uint32_t topLength;    // Compressed bytes
+    uint32_t topRawLength;
+    uint32_t topNodeCount;
+    uint32_t generator;    // Hash of the generator's parameters
+
+    static const uint32_t Version = 2;
+    static const uint32_t MergedFlag = 1;
+};
+static_assert(sizeof(ChunkedWorldHeader) == 72, "ChunkedWorldHeader is written to disk as is");
+
+// Index entry for one chunk. Entries are sorted by coordinate, x first.
+// Identical chunks of a merged tree share one record.
+struct ChunkedWorldChunk {
+    int32_t x, y, z;
+    uint32_t nodeCount;
+    uint64_t offset;
+    uint32_t length;       // Compressed bytes
+    uint32_t rawLength;
+};
+static_assert(sizeof(ChunkedWorldChunk) == 32, "ChunkedWorldChunk is written to disk as is");
+
+// A saved octree split into independently compressed chunks, for worlds
+// too large to read whole. The file is mapped, so reading a chunk touches
+// only its own pages, and chunks can be decoded on several threads at once.
+class ChunkedWorldFile {
+public:
+    static const int DefaultChunkDepth = 3;
+
+    // Writes octree to path, compressing the chunks on threadCount threads.
+    // chunkDepth is clamped to [1, maxDepth].
+    static bool Save(const SparseVoxelOctree& octree, const std::string& path, uint32_t seed, uint32_t generator,
+                     int chunkDepth = DefaultChunkDepth, int threadCount = 1);
+
+    // Maps the file and checks its header and index. Returns false, with a
+    // message, if it is missing, from another version or truncated.
+    bool Open(const std::string& path);
+    void Close() { m_file.Close(); }
+    bool IsOpen() const { return m_file.IsOpen(); }
+    // True if the file holds a world made with these settings and a
+    // generator with this parameter hash.
+    bool Matches(int size, int maxDepth, uint32_t seed, uint32_t generator) const;
+
+    const ChunkedWorldHeader& Header() const { return *reinterpret_cast<const ChunkedWorldHeader*>(m_file.Data()); }
+    size_t ChunkCount() const { return Header().chunkCount; }
+    const ChunkedWorldChunk& Chunk(size_t index) const {
+        return reinterpret_cast<const ChunkedWorldChunk*>(m_file.Data() + Header().indexOffset)[index];
+    }
+    // Index of the chunk at coord, or -1 if that part of the world is empty
+    // or covered by a leaf above chunkDepth.
+    int FindChunk(glm::ivec3 coord) const;
+
+    // Decodes one chunk into nodes and colors, its root first and child
+    // indices local to the chunk. Safe to call from several threads.
+    // Returns false if the record is corrupt.
+    bool ReadChunk(size_t index, std::vector<FlattenedNode>& nodes, std::vector<uint32_t>& colors) const;
+
+private:
+    friend class SparseVoxelOctree;
+    // Decodes a record of nodeCount nodes whose root is at depth. In the top
+    // record, children at chunkDepth are appended to chunkSlots as node
+    // index * 8 + octant instead of being read, and their coordinates to
+    // chunkCoords.
+    bool ReadRecord(uint64_t offset, uint32_t length, uint32_t rawLength, uint32_t nodeCount, int depth,
+                    std::vector<FlattenedNode>& nodes, std::vector<uint32_t>& colors,
+                    std::vector<int>* chunkSlots, std::vector<glm::ivec3>* chunkCoords) const;
+
+    MappedFile m_file;
+};
+
+#endif
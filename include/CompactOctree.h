@@ -0,0 +1,58 @@
+#ifndef COMPACT_OCTREE_H
+#define COMPACT_OCTREE_H
+
+#include "Octree.h"
+#include <cstdint>
+#include <vector>
+
+// ESVO-style node: instead of eight child slots a node stores which octants
+// exist and where its first child lives. Siblings are stored next to each
+// other in octant order, so child i sits at childBase + popcount of the
+// valid bits below i. Matches CompactNode in compute.glsl (std430, 8 bytes);
+// colors are a separate stream indexed like the nodes.
+struct CompactNode {
+    uint32_t childBase = 0;
+    uint8_t validMask = 0;  // Bit i set if octant i has a child
+    uint8_t leafMask = 0;   // Bit i set if that child is a leaf
+    uint16_t flags = 0;     // RootLeafFlag, on the root only
+
+    // A child's leafness is in its parent's leaf mask; the root has no
+    // parent, so it carries its own.
+    static const uint16_t RootLeafFlag = 1;
+};
+static_assert(sizeof(CompactNode) == 8, "CompactNode must match the std430 layout in compute.glsl");
+
+class CompactOctree {
+public:
+    // Re-encodes the octree breadth first so every sibling group is contiguous.
+    explicit CompactOctree(const SparseVoxelOctree& octree);
+    // Same query as SparseVoxelOctree::Lookup on the compact encoding.
+    bool Lookup(glm::ivec3 point, glm::vec4* color = nullptr) const;
+    // Index of the child in octant, or -1 when that octant is empty.
+    int ChildIndex(int nodeIndex, int octant) const {
+        const CompactNode& node = m_nodes[nodeIndex];
+        if (!(node.validMask & (1u << octant)))
+            return -1;
+        return static_cast<int>(node.childBase) + PopCount(node.validMask & ((1u << octant) - 1));
+    }
+    const std::vector<CompactNode>& Nodes() const { return m_nodes; }
+    const std::vector<uint32_t>& Colors() const { return m_colors; }
+private:
+    static int PopCount(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcount(bits);
+#else
+        int count = 0;
+        for (; bits; bits &= bits - 1)
+            count++;
+        return count;
+#endif
+    }
+    std::vector<CompactNode> m_nodes;
+    std::vector<uint32_t> m_colors;
+    int m_maxDepth;
+    std::vector<int> m_halfSizes;
+    bool m_rootIsLeaf;
+};
+
+#endif
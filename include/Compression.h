@@ -0,0 +1,43 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Byte-oriented LZ77 in the style of LZ4: each sequence is a token holding
+// the literal and match lengths, the literals, and a 16-bit match offset.
+// Fast to decode, and good enough on node data once it has been delta
+// encoded. The format is only read back by LzDecompress.
+
+// Appends the compressed form of data to out.
+void LzCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// Decompresses exactly size bytes into out. Returns false if the input is
+// corrupt or doesn't decode to exactly size bytes; out is never overrun.
+bool LzDecompress(const uint8_t* data, size_t length, uint8_t* out, size_t size);
+
+// LEB128 varints, for the streams that get compressed.
+inline void WriteVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Returns false if the varint runs past end or is too long.
+inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t* value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef CSG_SHAPE_H
+#define CSG_SHAPE_H
+
+#include <glm/glm.hpp>
+
+// Solid analytic shape for SparseVoxelOctree::Combine, in octree
+// coordinates. A voxel belongs to the shape when its cell's center does.
+class CsgShape {
+public:
+    // How much of a box the shape covers.
+    enum class Coverage {
+        None,
+        Partial,
+        Full
+    };
+
+    static CsgShape Sphere(glm::vec3 center, float radius);
+    // The box [min, max].
+    static CsgShape Box(glm::vec3 min, glm::vec3 max);
+    // Every point within radius of the segment from a to b.
+    static CsgShape Capsule(glm::vec3 a, glm::vec3 b, float radius);
+
+    bool Contains(glm::vec3 point) const;
+    // Full only if every point of the box [lo, hi] is inside and None only
+    // if none is; Partial may also be returned for boxes that are one or the
+    // other, which costs a descent but never a wrong answer.
+    Coverage Classify(glm::vec3 lo, glm::vec3 hi) const;
+private:
+    enum class Kind {
+        Sphere,
+        Box,
+        Capsule
+    };
+    CsgShape(Kind kind, glm::vec3 a, glm::vec3 b, float radius) : m_kind(kind), m_a(a), m_b(b), m_radius(radius) {}
+    float SegmentDistance(glm::vec3 point) const;
+
+    Kind m_kind;
+    glm::vec3 m_a; // Sphere center, box min or capsule start
+    glm::vec3 m_b; // Box max or capsule end
+    float m_radius;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef DENSITY_FIELD_H
+#define DENSITY_FIELD_H
+
+#include "Octree.h"
+#include "Terrain.h"
+
+// What Generate did, for the startup report.
+struct DensityStats {
+    size_t airChunks = 0;    // Skipped: no solid voxel
+    size_t solidChunks = 0;  // Skipped: solid with their border, so hidden
+    size_t mixedChunks = 0;
+    size_t noiseSamples = 0; // Voxels that needed the 3D noise
+    size_t voxels = 0;       // Emitted
+};
+
+// 3D terrain on a heightfield's grid, with overhangs and caves. Voxel
+// (ix, iy, iz) sits at (ix, iy, iz) * spacing and is solid where
+//   density = height(ix, iz) - y + caves(x, y, z)
+// is positive. The 3D noise stack can only move the surface by its
+// amplitude limits, so it only shapes a band around the heightfield. The
+// bottom layer is bedrock and always solid; outside the grid counts as
+// solid at the sides and bottom and as air above, so the world's sides
+// and underside aren't drawn.
+//
+// The terrain and surface are referenced, not copied.
+class DensityField {
+public:
+    DensityField(const TerrainGenerator& terrain, const Heightfield& surface, const NoiseStack& caves, int layers);
+
+    float Density(int ix, int iy, int iz) const;
+    bool Solid(int ix, int iy, int iz) const;
+
+    // Appends the solid voxels that touch air, the ones a ray can hit,
+    // colored like their heightfield column. The grid is cut into
+    // chunkSize^3 chunks, which threadCount workers take by columns. Each
+    // chunk is first classified from bounds: the heightfield's range over
+    // its columns and the noise stack's Min and Max. A chunk with no solid
+    // voxel, or solid together with its one voxel border so nothing in it
+    // shows, is skipped without sampling noise. In the mixed chunks the
+    // same bounds decide each voxel whose height alone settles it, and only
+    // the rest sample the 3D noise. The voxels come out in chunk order,
+    // whatever the thread count, and match testing every voxel with Solid.
+    DensityStats Generate(std::vector<Voxel>& voxels, int threadCount, int chunkSize = 16) const;
+
+private:
+    // Solid from the height term when the noise can't change the answer,
+    // else from Density; counts the noise lookups in samples.
+    bool SolidBounded(int ix, int iy, int iz, size_t& samples) const;
+
+    const TerrainGenerator& m_terrain;
+    const Heightfield& m_surface;
+    NoiseStack m_caves;
+    float m_noiseMin;
+    float m_noiseMax;
+    int m_layers;
+};
+
+#endif
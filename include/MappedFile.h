@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only. Pages are read in as they are touched, so
+// any number of threads can read different parts of a large file at once
+// without loading the rest.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false, with a message, if the file is missing or empty.
+    // sequential hints that the file will be read front to back.
+    bool Open(const std::string& path, bool sequential);
+    void Close();
+    bool IsOpen() const { return m_data != nullptr; }
+    const char* Data() const { return m_data; }
+    size_t Length() const { return m_length; }
+private:
+    const char* m_data = nullptr;
+    size_t m_length = 0;
+#ifdef _WIN32
+    std::string m_buffer; // No mmap; the file is read into memory instead
+#endif
+};
+
+#endif
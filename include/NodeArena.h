@@ -0,0 +1,183 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include "Atomic.h"
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Growable array stored in fixed-size blocks. Growing allocates a new block
+// and never moves existing elements, so there is no reallocation spike and no
+// need to reserve for the worst case up front. Indexing is a shift and a mask.
+// The element interface mirrors the std::vector subset the octree uses.
+template <typename T, int BlockBits = 16>
+class NodeArena {
+public:
+    static constexpr size_t BlockSize = size_t(1) << BlockBits;
+    // Enough blocks for every index an int can hold.
+    static constexpr size_t MaxBlocks = (size_t(1) << 31) >> BlockBits;
+
+    NodeArena() = default;
+    ~NodeArena() { clear(); }
+    NodeArena(NodeArena&& other) noexcept { swap(other); }
+    NodeArena& operator=(NodeArena&& other) noexcept {
+        NodeArena moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    T& operator[](size_t index) { return m_blocks[index >> BlockBits][index & (BlockSize - 1)]; }
+    const T& operator[](size_t index) const { return m_blocks[index >> BlockBits][index & (BlockSize - 1)]; }
+    T& back() { return (*this)[m_size - 1]; }
+
+    void push_back(const T& value) {
+        if (m_size == m_blocks.size() * BlockSize)
+            AddBlock();
+        (*this)[m_size++] = value;
+    }
+
+    // Grows with copies of value, or drops elements from the end. Blocks past
+    // the new end are freed.
+    void resize(size_t count, const T& value = T()) {
+        while (m_blocks.size() * BlockSize < count)
+            AddBlock();
+        for (size_t i = m_size; i < count; i++)
+            (*this)[i] = value;
+        m_size = count;
+        TrimBlocks();
+        m_staging = std::vector<T>();
+    }
+
+    // Replaces the contents with count elements copied from data.
+    void assign(const T* data, size_t count) {
+        clear();
+        while (m_blocks.size() * BlockSize < count)
+            AddBlock();
+        for (size_t first = 0; first < count; first += BlockSize) {
+            size_t run = count - first < BlockSize ? count - first : BlockSize;
+            std::memcpy(static_cast<void*>(m_blocks[first >> BlockBits]), data + first, run * sizeof(T));
+        }
+        m_size = count;
+    }
+
+    // Frees every block; unlike std::vector::clear the memory is returned.
+    void clear() {
+        for (T* block : m_blocks)
+            delete[] block;
+        m_blocks = std::vector<T*>();
+        m_staging = std::vector<T>();
+        m_size = 0;
+    }
+
+    void swap(NodeArena& other) {
+        m_blocks.swap(other.m_blocks);
+        m_staging.swap(other.m_staging);
+        std::swap(m_size, other.m_size);
+    }
+
+    // Concurrent appends. Between BeginConcurrent and EndConcurrent the block
+    // table has room for MaxBlocks and never moves, and blocks are created
+    // on first use with a compare-exchange, so any number of threads may
+    // append and index at once without locks. Nothing else may be called.
+    void BeginConcurrent() {
+        m_blocks.resize(MaxBlocks, nullptr);
+    }
+
+    // Reserves count new elements, value-initialized, and returns the first.
+    size_t AppendConcurrent(size_t count) {
+        size_t first = AtomicFetchAdd(&m_size, count);
+        EnsureBlocks(first, count);
+        return first;
+    }
+
+    // Indexing while other threads may be creating blocks.
+    T& AtConcurrent(size_t index) {
+        return AtomicLoad(&m_blocks[index >> BlockBits])[index & (BlockSize - 1)];
+    }
+
+    // Makes elements [first, first + count) exist, growing the size to cover
+    // them; for an arena that shares its indices with another one.
+    void EnsureConcurrent(size_t first, size_t count) {
+        EnsureBlocks(first, count);
+        size_t size = AtomicLoad(&m_size);
+        while (size < first + count) {
+            if (AtomicCompareExchange(&m_size, size, first + count))
+                break;
+        }
+    }
+
+    void EndConcurrent() {
+        TrimBlocks();
+    }
+
+    // Calls visit(data, first, count) for each block in order, where data
+    // holds elements [first, first + count). Lets an upload stream the blocks
+    // without building a contiguous copy.
+    template <typename Visit>
+    void ForEachBlock(Visit visit) const {
+        ForEachBlock(0, m_size, visit);
+    }
+
+    // Same, limited to elements [first, first + count).
+    template <typename Visit>
+    void ForEachBlock(size_t first, size_t count, Visit visit) const {
+        size_t end = first + count < m_size ? first + count : m_size;
+        while (first < end) {
+            size_t offset = first & (BlockSize - 1);
+            size_t run = BlockSize - offset < end - first ? BlockSize - offset : end - first;
+            visit(static_cast<const T*>(m_blocks[first >> BlockBits] + offset), first, run);
+            first += run;
+        }
+    }
+
+    // All elements in one array. A single block is handed out as is; more
+    // are gathered into a staging copy that stays valid until the next call
+    // or resize. Not safe to call from several threads at once.
+    const T* Contiguous() const {
+        if (m_blocks.size() <= 1)
+            return m_blocks.empty() ? nullptr : m_blocks[0];
+        m_staging.resize(m_size);
+        ForEachBlock([&](const T* data, size_t first, size_t count) {
+            std::memcpy(static_cast<void*>(&m_staging[first]), data, count * sizeof(T));
+        });
+        return m_staging.data();
+    }
+
+    // Bytes held by the blocks, including the unused tail of the last one.
+    size_t MemoryUsage() const { return m_blocks.size() * BlockSize * sizeof(T); }
+
+private:
+    // Blocks are value-initialized so padding bytes are zero and uploads are
+    // deterministic.
+    void AddBlock() {
+        m_blocks.push_back(new T[BlockSize]());
+    }
+
+    void EnsureBlocks(size_t first, size_t count) {
+        for (size_t block = first >> BlockBits; block <= (first + count - 1) >> BlockBits; block++) {
+            if (AtomicLoad(&m_blocks[block]))
+                continue;
+            T* created = new T[BlockSize]();
+            T* expected = nullptr;
+            if (!AtomicCompareExchange(&m_blocks[block], expected, created))
+                delete[] created; // Another thread got there first
+        }
+    }
+
+    // Frees blocks past the end, including unused concurrent table slots.
+    void TrimBlocks() {
+        size_t used = (m_size + BlockSize - 1) >> BlockBits;
+        for (size_t block = used; block < m_blocks.size(); block++)
+            delete[] m_blocks[block];
+        m_blocks.resize(used);
+    }
+
+    std::vector<T*> m_blocks; // Owned
+    mutable std::vector<T> m_staging;
+    size_t m_size = 0;
+};
+
+#endif
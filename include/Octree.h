@@ -0,0 +1,422 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+#include "NodeArena.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class OctreeSnapshot;
+class CsgShape;
+class OctreeFile;
+class ChunkedWorldFile;
+struct OctreeStats;
+class Heightfield;
+
+// Topology only; node colors live in a separate array under the same index so
+// a traversal that doesn't shade never pulls them into cache.
+struct FlattenedNode {
+    bool IsLeaf = false;
+    char padding1[3];       // Pad bool to 4 bytes
+    int childIndices[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+};
+static_assert(sizeof(FlattenedNode) == 36, "FlattenedNode must match the std430 layout in compute.glsl");
+
+// Colors in GPU-facing formats are packed RGBA8, matching GLSL unpackUnorm4x8.
+inline uint32_t PackColor(glm::vec4 color) {
+    return glm::packUnorm4x8(color);
+}
+
+inline glm::vec4 UnpackColor(uint32_t color) {
+    return glm::unpackUnorm4x8(color);
+}
+
+// How FilterColors derives an interior node's color from its children.
+// Either way a filtered interior node's alpha holds the fraction of its cube
+// that is solid, so a node can be refiltered from its children alone.
+enum class ColorFilter {
+    Average,          // Plain mean of the existing children
+    CoverageWeighted  // Children weighted by the fraction of their cube that is solid
+};
+
+// Orders Reorder can lay the node array out in. The root stays at index 0.
+enum class NodeLayout {
+    BreadthFirst,  // Level by level, as Build emits it
+    DepthFirst,    // Pre-order, with each node's children stored next to each other
+    VanEmdeBoas    // Split by height recursively, so a subtree of h levels spans few cache lines
+};
+
+// Boolean operations for SparseVoxelOctree::Combine.
+enum class CsgOp {
+    Union,     // Solid where either is; the second operand's colors win
+    Subtract,  // Solid where the first is and the second isn't
+    Intersect  // Solid where both are; colors from the first
+};
+
+// A single voxel as handed to the bulk builder.
+struct Voxel {
+    glm::vec3 position;
+    glm::vec4 color;
+};
+
+// First leaf a ray enters. distance is the ray parameter t at which it
+// enters, in units of the direction's length; 0 if the origin is inside.
+struct RayHit {
+    float distance;
+    int nodeIndex; // -1 for a miss
+    uint32_t color;
+};
+
+// Eight rays in structure-of-arrays form, for SparseVoxelOctree::Raycast8.
+struct RayPacket {
+    float originX[8], originY[8], originZ[8];
+    float directionX[8], directionY[8], directionZ[8];
+    float maxDistance[8];
+};
+
+class SparseVoxelOctree {
+public:
+    // Morton key of a voxel together with its position in the input.
+    struct KeyedVoxel {
+        uint64_t key;
+        uint32_t order; // Later voxels win colors
+    };
+
+    SparseVoxelOctree(int size, int maxDepth);
+    void Insert(glm::vec3 point, glm::vec4 color);
+    // Fills every voxel with integer coordinates in [min, max] (inclusive).
+    // Nodes whose whole cell lies inside the box become a single leaf at
+    // that depth instead of being subdivided down to voxels.
+    void InsertSolid(glm::ivec3 min, glm::ivec3 max, glm::vec4 color);
+    // Same result as calling Insert on each voxel in order, but each voxel
+    // only walks down from the deepest node it shares with the one before
+    // it, and a node is refiltered once, when the walk leaves it. Runs
+    // of nearby voxels (columns, scanlines, sorted input) gain the most.
+    void InsertBatch(const Voxel* voxels, size_t count);
+    void InsertBatch(const std::vector<Voxel>& voxels) { InsertBatch(voxels.data(), voxels.size()); }
+    // Same as an Insert for every integer y in [yMin, yMax] at (x, z), but
+    // walks the run once, one leaf cell at a time.
+    void InsertColumn(int x, int z, int yMin, int yMax, glm::vec4 color);
+    // Concurrent inserts. Between BeginConcurrentInsert and
+    // EndConcurrentInsert any number of threads may call InsertConcurrent,
+    // and nothing else may touch the octree. Child slots are claimed with
+    // compare-and-swap and new nodes come from the arena's lock-free block
+    // allocator, so no thread ever waits on another. Leaves end up as with
+    // serial inserts; which thread's color an interior node keeps depends on
+    // timing, so run FilterColors afterwards. Collapsed leaves are treated as
+    // already holding the point and are not split, and the collapse flag is
+    // ignored.
+    void BeginConcurrentInsert();
+    void InsertConcurrent(glm::vec3 point, glm::vec4 color);
+    // Puts nodes that lost a race for a slot on the free list.
+    void EndConcurrentInsert();
+    // Empties the voxel containing point, splitting a collapsed leaf around
+    // it first. Ancestors left without children are freed as well, and their
+    // slots are reused by later inserts. Returns false if it was empty.
+    bool Remove(glm::ivec3 point);
+    // Recolors the voxel containing point; a collapsed leaf is split so only
+    // that voxel changes. Returns false if it is empty.
+    bool SetColor(glm::ivec3 point, glm::vec4 color);
+    // Boolean operation between this octree and other, in place. Both must
+    // have the same size and maxDepth. The trees are walked together node by
+    // node: wherever one side is a leaf or empty, the other side's subtree
+    // is kept, dropped or copied as a whole, so the work follows the places
+    // where both have detail. Emptied nodes are freed. Returns false if the
+    // trees don't match.
+    bool Combine(const SparseVoxelOctree& other, CsgOp op);
+    // Same with an analytic shape, filled with color for a union. Cells
+    // wholly inside or outside the shape are settled without descending, so
+    // the work follows the shape's surface, not its volume.
+    bool Combine(const CsgShape& shape, CsgOp op, glm::vec4 color = glm::vec4(1.0f));
+    // When set, Insert and InsertSolid collapse any node whose eight children
+    // end up as leaves of one color, recycling the children's slots.
+    void SetCollapseOnInsert(bool collapse) { m_collapseOnInsert = collapse; }
+    // Replaces every subtree that is a full set of same-colored leaves with
+    // one leaf, bottom up, then compacts the node array. Returns how many
+    // reachable nodes the collapse removed, not counting the free or
+    // unreachable slots compacting drops as well.
+    size_t CollapseUniformSubtrees();
+    // Replaces the whole tree with the given voxel set. Voxels are sorted by
+    // their Morton key and the node array is emitted in one linear pass, with
+    // colors settled from the leaves up as subtrees are closed. The result
+    // holds the same tree as calling Insert on every voxel in order (later
+    // voxels win colors), with nodes laid out breadth first and siblings
+    // stored next to each other.
+    void Build(const std::vector<Voxel>& voxels);
+    // Same as Build, spread over threadCount workers. The cube is split into
+    // sub-cubes that are sorted, counted and emitted independently into their
+    // own ranges of the node array; the output is byte for byte the serial one.
+    void Build(const std::vector<Voxel>& voxels, int threadCount);
+    // Replaces the whole tree with a heightfield's surface. Each sample
+    // fills its column from height - depthBelow up to height, the voxels
+    // main builds from a sample. With collapse off the result is the tree
+    // Build makes from those voxels, layout included. With collapse on it
+    // has the leaves and nodes that inserting them with collapse gives,
+    // laid out breadth first. Instead of keying voxels, the columns' lowest
+    // and highest filled cells go into a min/max pyramid, one level per
+    // depth, and nodes are emitted top-down: a node clear of every span
+    // below it is skipped without looking further, so the work follows the
+    // surface, not the volume. With collapse on, solid one-colored nodes
+    // become single leaves the same way.
+    void BuildFromHeightfield(const Heightfield& field, float depthBelow);
+    // Recomputes every interior node's color from its children, bottom up,
+    // so a traversal can stop at a coarse node and still shade it sensibly.
+    // Nodes of equal height are independent and are filtered in parallel.
+    // Inserts, Remove, SetColor and Combine refilter the nodes they pass
+    // with the last filter used (CoverageWeighted before any call), so
+    // coarse colors follow edits.
+    void FilterColors(ColorFilter filter, int threadCount = 1);
+    // Turns the tree into a DAG: subtrees that are identical, colors
+    // included, are stored once and shared by every parent pointing at them.
+    // The node format is unchanged, so every traversal works as before.
+    // Returns how many nodes were removed. A merged tree rejects Insert,
+    // since a write would show up in every place sharing the subtree.
+    size_t MergeIdenticalSubtrees();
+    bool IsMerged() const { return m_merged; }
+    // Rewrites the node and color arrays in the given order and remaps every
+    // child index, so parents and children a traversal visits together sit
+    // together in memory. Unreachable and free slots are dropped.
+    void Reorder(NodeLayout layout);
+    // Path of octant indices from the root to the leaf containing point, three
+    // bits per level with the root's octant in the highest bits.
+    uint64_t MortonKey(glm::ivec3 point) const;
+    // Finds the leaf containing point. Returns false for empty space.
+    bool Lookup(glm::ivec3 point, glm::vec4* color = nullptr) const;
+    // Calls visit(lo, hi, color) for every leaf overlapping the box of
+    // integer points [min, max] (inclusive), with the leaf's cell clipped to
+    // the box: the points [lo, hi) all hold color. A collapsed leaf is one
+    // call. Leaves come in Morton order. Returns the number of points
+    // visited. Walks with a fixed stack and allocates nothing.
+    template <typename Visit>
+    size_t ForEachLeafInBox(glm::ivec3 min, glm::ivec3 max, Visit visit) const;
+    // Finds the highest solid voxel in the column through from at or below
+    // from.y, and sets height to the top of its cell, where something
+    // standing on it rests. Returns false if the column is empty below from
+    // or lies outside the cube.
+    bool FindGround(glm::ivec3 from, int* height, glm::vec4* color = nullptr) const;
+    // A voxel (a cell at maxDepth) found by FindNearest. distanceSquared is
+    // measured from the query point to the closest point of [lo, hi).
+    struct NearestVoxel {
+        glm::ivec3 lo;
+        glm::ivec3 hi;
+        uint32_t color;
+        float distanceSquared;
+    };
+    // Writes up to k voxels within maxDistance of point to nearest, closest
+    // first, and returns how many it found. Collapsed leaves count as the
+    // voxels they cover. Branch and bound over a fixed stack, children in
+    // order of distance, so no allocation.
+    size_t FindNearest(glm::vec3 point, float maxDistance, NearestVoxel* nearest, size_t k) const;
+    // Finds the first leaf along the ray closer than maxDistance. Cells are
+    // the tree's own integer cells, the ones Lookup uses. Children are
+    // visited front to back in an order fixed by the direction's signs, so
+    // the first leaf entered is the answer. Fixed stack, no allocation.
+    bool Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit* hit) const;
+    // Raycast for eight rays at once, traversing the tree together: each
+    // node's box is tested against all eight with AVX2 where the CPU has it
+    // and per ray otherwise. Coherent rays (neighbouring pixels) share most
+    // of their nodes and benefit most. Writes a hit or miss for every ray
+    // and returns a mask of the rays that hit.
+    int Raycast8(const RayPacket& packet, RayHit* hits) const;
+    // Octant of the child holding point for a node at position whose
+    // children are `half` wide, using the same integer split as Insert.
+    // Moves position to that child's corner.
+    static int ChildOctant(glm::ivec3 point, glm::ivec3& position, int half) {
+        glm::ivec3 childPos = {
+            (point.x >= position.x + half) ? 1 : 0,
+            (point.y >= position.y + half) ? 1 : 0,
+            (point.z >= position.z + half) ? 1 : 0
+        };
+        position += childPos * half;
+        return (childPos.x << 2) | (childPos.y << 1) | childPos.z;
+    }
+    // Node indices [first, first + count) whose node or color changed.
+    struct NodeRange {
+        size_t first;
+        size_t count;
+    };
+    // Returns the ranges changed since the last call, merged and sorted, and
+    // clears them. Edits are tracked in pages of 2^DirtyPageBits nodes; bulk
+    // rewrites (Build, Reorder, merges, filtering) report the whole array.
+    std::vector<NodeRange> TakeDirtyRanges();
+    static const int DirtyPageBits = 5;
+    // Replaces the tree with the one saved in file, copying the mapped node
+    // and color arrays in as they are. Fails if the file was saved with a
+    // different size or maxDepth.
+    bool Load(const OctreeFile& file);
+    // Same for a chunked world, decoding the chunks on threadCount threads.
+    bool Load(const ChunkedWorldFile& file, int threadCount);
+    // Freezes the current tree into an immutable snapshot, makes it the one
+    // Snapshot() returns and returns it. Snapshots are split into chunks of
+    // 2^SnapshotChunkBits nodes; chunks nothing wrote to since the previous
+    // Publish are shared with it, so only edited chunks are copied. Returns
+    // the previous snapshot if nothing changed.
+    std::shared_ptr<const OctreeSnapshot> Publish();
+    // The latest published snapshot, or null before the first Publish. Safe
+    // to call from any thread while the writer edits and publishes; readers
+    // keep what they got alive for as long as they hold it, and a chunk is
+    // freed when the last snapshot using it goes.
+    std::shared_ptr<const OctreeSnapshot> Snapshot() const;
+    static const int SnapshotChunkBits = 12;
+    // Walks the tree and counts what it holds and what it costs. Counting
+    // duplicate subtrees hashes every node, about as slow as a merge, so it
+    // can be left out. Phases are left for the caller to fill in.
+    OctreeStats Stats(bool countDuplicates = true) const;
+    int Size() const { return m_size; }
+    int MaxDepth() const { return m_maxDepth; }
+    const std::vector<int>& HalfSizes() const { return m_halfSizes; }
+    const NodeArena<FlattenedNode>& Nodes() const { return m_nodes; }
+    const NodeArena<uint32_t>& Colors() const { return m_colors; }
+private:
+    // The nodes the last batched insert passed, with their cells [lo, hi).
+    // Each one still owes color, written when the walk leaves it.
+    // Fixed arrays, like EmitSubtree's path, so starting one costs nothing.
+    struct InsertPath {
+        explicit InsertPath(int size);
+        int nodes[64];
+        glm::ivec3 lo[64];
+        glm::ivec3 hi[64];
+        int depth = 0;     // Deepest node on the path
+        uint32_t color = 0;
+    };
+
+    void InsertImpl(int nodeIndex, glm::ivec3 point, uint32_t color, glm::ivec3 position, int depth);
+    void InsertSolidImpl(int nodeIndex, glm::ivec3 min, glm::ivec3 max, uint32_t color,
+                         glm::ivec3 lo, glm::ivec3 hi, int depth);
+    void InsertAlongPath(InsertPath& path, glm::ivec3 point, uint32_t color);
+    // Combine one node with its counterpart in other or in the shape.
+    // Return false if nothing is left in the node; the caller frees it.
+    bool CombineImpl(int nodeIndex, const SparseVoxelOctree& other, int otherIndex, CsgOp op, int depth);
+    bool CombineShapeImpl(int nodeIndex, const CsgShape& shape, CsgOp op, uint32_t color,
+                          glm::ivec3 lo, glm::ivec3 hi, int depth);
+    // Copies the subtree at otherIndex in other into this octree.
+    int CopySubtree(const SparseVoxelOctree& other, int otherIndex);
+    // Frees every child of the node, leaving IsLeaf alone.
+    void ClearChildren(int nodeIndex);
+    bool HasContent(int nodeIndex) const;
+    // The filtered color of an interior node, from its children.
+    uint32_t FilteredColor(int nodeIndex, ColorFilter filter) const;
+    // Refilters the interior nodes path[count - 1] up to path[0].
+    void RefilterPath(const int* path, int count);
+    // Settles the nodes on the path below depth; -1 settles the root too.
+    void ClosePath(InsertPath& path, int depth);
+    void MarkDirty(int nodeIndex) {
+        SetBit(m_dirtyPages, static_cast<size_t>(nodeIndex) >> DirtyPageBits);
+        SetBit(m_unpublishedChunks, static_cast<size_t>(nodeIndex) >> SnapshotChunkBits);
+    }
+    void MarkAllDirty() {
+        m_allDirty = true;
+        m_allUnpublished = true;
+    }
+    static void SetBit(std::vector<uint64_t>& bits, size_t index) {
+        if ((index >> 6) >= bits.size())
+            bits.resize((index >> 6) + 1, 0);
+        bits[index >> 6] |= uint64_t(1) << (index & 63);
+    }
+    int AllocateConcurrent();
+    // Pushes an unlinked node onto a lock-free list threaded through
+    // childIndices[0], emptied into m_freeNodes by EndConcurrentInsert.
+    void PushOrphan(int nodeIndex);
+    // Takes a slot from the free list, or appends one.
+    int AllocateNode();
+    void FreeSubtree(int nodeIndex);
+    // Turns a leaf above maxDepth back into eight leaves of its color.
+    void SplitLeaf(int nodeIndex);
+    // Makes nodeIndex a leaf if its eight children are leaves of one color.
+    // recycle puts the children on the free list; leave it off when other
+    // parents may still point at them.
+    bool TryCollapse(int nodeIndex, bool recycle);
+    // Appends the nodes of the subtree at root, levels deep, to order in van
+    // Emde Boas order: the top half of the levels, then each subtree below it.
+    void LayoutVanEmdeBoas(int root, int levels, std::vector<int>& order, std::vector<int>& newIndex) const;
+    // Numbers the distinct subtrees reachable from the root, colors
+    // included: returns each node's id, -1 if unreachable, and fills
+    // representatives with one node per id.
+    std::vector<int> SubtreeIds(std::vector<int>& representatives) const;
+    uint64_t AxisKey(int coord) const;
+    // Index of the cell at maxDepth holding coord along one axis: the
+    // octant path's bits for that axis. Clamped to the cube like AxisKey.
+    int AxisCell(int coord) const;
+    // Deepest level whose node both keys pass through.
+    int SharedDepth(uint64_t a, uint64_t b) const;
+    std::vector<uint64_t> AxisKeyTable() const;
+    uint64_t KeyOf(const std::vector<uint64_t>& axisKeys, glm::vec3 position) const;
+    void SortVoxels(const std::vector<Voxel>& voxels, std::vector<KeyedVoxel>& keyed) const;
+    void CountNodes(const KeyedVoxel* keyed, size_t count, int rootDepth, std::vector<int>& counts) const;
+    // Writes the nodes below rootIndex for a sorted run of keys, taking
+    // indices from cursors[depth]. Returns the last voxel order in the run.
+    uint32_t EmitSubtree(const KeyedVoxel* keyed, size_t count, const std::vector<Voxel>& voxels,
+                         int rootDepth, int rootIndex, std::vector<int>& cursors);
+    NodeArena<FlattenedNode> m_nodes;
+    NodeArena<uint32_t> m_colors; // Packed RGBA8 per node, default white
+    int m_size;
+    int m_maxDepth;
+    std::vector<int> m_halfSizes; // Child offset at each depth, i.e. int(m_size / 2^depth / 2)
+    bool m_merged = false;
+    bool m_collapseOnInsert = false;
+    ColorFilter m_colorFilter = ColorFilter::CoverageWeighted; // Last one FilterColors used
+    std::vector<int> m_freeNodes; // Slots released by collapses, reused by AllocateNode
+    std::vector<uint64_t> m_dirtyPages; // One bit per page of nodes changed since TakeDirtyRanges
+    bool m_allDirty = true;             // Nothing has been taken yet
+    std::vector<uint64_t> m_unpublishedChunks; // One bit per snapshot chunk changed since Publish
+    bool m_allUnpublished = true;
+    std::shared_ptr<const OctreeSnapshot> m_published;
+    uint64_t m_version = 0;
+    int m_orphanHead = -1;              // See PushOrphan
+};
+
+template <typename Visit>
+size_t SparseVoxelOctree::ForEachLeafInBox(glm::ivec3 min, glm::ivec3 max, Visit visit) const {
+    min = glm::max(min, glm::ivec3(0));
+    glm::ivec3 end = glm::min(max, glm::ivec3(m_size - 1)) + 1;
+    if (glm::any(glm::greaterThanEqual(min, end)) || m_maxDepth >= 64)
+        return 0;
+    auto volume = [](glm::ivec3 lo, glm::ivec3 hi) {
+        return static_cast<size_t>(hi.x - lo.x) * (hi.y - lo.y) * (hi.z - lo.z);
+    };
+    if (m_nodes[0].IsLeaf) {
+        visit(min, end, m_colors[0]);
+        return volume(min, end);
+    }
+    // One frame per level: the node, its cell and the next octant to try.
+    struct Frame {
+        int node;
+        int octant;
+        glm::ivec3 lo;
+        glm::ivec3 hi;
+    };
+    Frame stack[64];
+    stack[0] = {0, 0, glm::ivec3(0), glm::ivec3(m_size)};
+    size_t points = 0;
+    int depth = 0;
+    while (depth >= 0) {
+        Frame& frame = stack[depth];
+        if (frame.octant == 8 || depth == m_maxDepth) {
+            depth--;
+            continue;
+        }
+        int octant = frame.octant++;
+        int child = m_nodes[frame.node].childIndices[octant];
+        if (child == -1)
+            continue;
+        int half = m_halfSizes[depth];
+        glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+        glm::ivec3 lo = frame.lo + offset * half;
+        glm::ivec3 hi = glm::mix(frame.lo + glm::ivec3(half), frame.hi, glm::equal(offset, glm::ivec3(1)));
+        glm::ivec3 clipLo = glm::max(lo, min);
+        glm::ivec3 clipHi = glm::min(hi, end);
+        if (glm::any(glm::greaterThanEqual(clipLo, clipHi)))
+            continue;
+        if (m_nodes[child].IsLeaf) {
+            visit(clipLo, clipHi, m_colors[child]);
+            points += volume(clipLo, clipHi);
+            continue;
+        }
+        stack[++depth] = {child, 0, lo, hi};
+    }
+    return points;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef OCTREE_FILE_H
+#define OCTREE_FILE_H
+
+#include "MappedFile.h"
+#include "Octree.h"
+#include <cstdint>
+#include <string>
+
+// On-disk layout: this header, then the node array and the color array,
+// each starting on a page boundary and stored exactly as the SSBOs hold
+// them, so a mapped file can be handed to the GPU or copied into an octree
+// without any decoding. Integers are little endian.
+struct OctreeFileHeader {
+    char magic[8];         // "SVOCTREE"
+    uint32_t version;
+    uint32_t headerSize;   // sizeof(OctreeFileHeader)
+    uint32_t nodeFormat;   // OctreeFileHeader::FlattenedNodes
+    uint32_t nodeSize;     // Bytes per node
+    int32_t size;
+    int32_t maxDepth;
+    uint32_t seed;         // Terrain seed the world was generated from
+    uint32_t flags;        // MergedFlag
+    uint32_t generator;    // Hash of the generator's parameters
+    uint32_t reserved;
+    uint64_t nodeCount;
+    uint64_t nodeOffset;   // Byte offsets from the start of the file
+    uint64_t colorOffset;
+
+    static const uint32_t Version = 2;
+    static const uint32_t FlattenedNodes = 1;
+    static const uint32_t MergedFlag = 1;
+    static const uint64_t Alignment = 4096;
+};
+static_assert(sizeof(OctreeFileHeader) == 72, "OctreeFileHeader is written to disk as is");
+
+// A saved octree, memory mapped read-only. Loading touches only the pages
+// that are read, so opening a large world costs no more than reading it.
+class OctreeFile {
+public:
+    // Writes octree to path, through a temporary file renamed into place so
+    // an interrupted save never leaves a truncated world behind.
+    static bool Save(const SparseVoxelOctree& octree, const std::string& path, uint32_t seed, uint32_t generator);
+
+    // Maps the file and checks its header. Returns false, with a message,
+    // if it is missing, from another version or node format, or truncated.
+    bool Open(const std::string& path);
+    void Close() { m_file.Close(); }
+    bool IsOpen() const { return m_file.IsOpen(); }
+    // True if the file holds a world made with these settings and a
+    // generator with this parameter hash.
+    bool Matches(int size, int maxDepth, uint32_t seed, uint32_t generator) const;
+
+    const OctreeFileHeader& Header() const { return *reinterpret_cast<const OctreeFileHeader*>(m_file.Data()); }
+    size_t NodeCount() const { return static_cast<size_t>(Header().nodeCount); }
+    // Point into the mapping; valid until Close.
+    const FlattenedNode* Nodes() const { return reinterpret_cast<const FlattenedNode*>(m_file.Data() + Header().nodeOffset); }
+    const uint32_t* Colors() const { return reinterpret_cast<const uint32_t*>(m_file.Data() + Header().colorOffset); }
+private:
+    MappedFile m_file;
+};
+
+#endif
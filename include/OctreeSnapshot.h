@@ -0,0 +1,45 @@
+#ifndef OCTREE_SNAPSHOT_H
+#define OCTREE_SNAPSHOT_H
+
+#include "Octree.h"
+#include <memory>
+#include <vector>
+
+// Immutable copy of an octree's nodes and colors at one Publish, for
+// readers that must not see a tree halfway through an edit. Nodes are held
+// in chunks of 2^SparseVoxelOctree::SnapshotChunkBits, each shared by every
+// snapshot in which it didn't change.
+class OctreeSnapshot {
+public:
+    using NodeChunk = std::shared_ptr<const std::vector<FlattenedNode>>;
+    using ColorChunk = std::shared_ptr<const std::vector<uint32_t>>;
+    static const int ChunkBits = SparseVoxelOctree::SnapshotChunkBits;
+
+    // Counts publishes of the octree; newer snapshots have higher versions.
+    uint64_t Version() const { return m_version; }
+    size_t NodeCount() const { return m_nodeCount; }
+    const FlattenedNode& Node(size_t index) const {
+        return (*m_nodeChunks[index >> ChunkBits])[index & ((size_t(1) << ChunkBits) - 1)];
+    }
+    uint32_t Color(size_t index) const {
+        return (*m_colorChunks[index >> ChunkBits])[index & ((size_t(1) << ChunkBits) - 1)];
+    }
+    // Same as SparseVoxelOctree::Lookup, on this version of the tree.
+    bool Lookup(glm::ivec3 point, glm::vec4* color = nullptr) const;
+    // Chunks are exposed so an uploader can skip the ones it already sent.
+    size_t ChunkCount() const { return m_nodeChunks.size(); }
+    const NodeChunk& NodeChunkAt(size_t chunk) const { return m_nodeChunks[chunk]; }
+    const ColorChunk& ColorChunkAt(size_t chunk) const { return m_colorChunks[chunk]; }
+    int MaxDepth() const { return m_maxDepth; }
+    const std::vector<int>& HalfSizes() const { return m_halfSizes; }
+private:
+    friend class SparseVoxelOctree;
+    std::vector<NodeChunk> m_nodeChunks;
+    std::vector<ColorChunk> m_colorChunks;
+    size_t m_nodeCount = 0;
+    uint64_t m_version = 0;
+    int m_maxDepth = 0;
+    std::vector<int> m_halfSizes;
+};
+
+#endif
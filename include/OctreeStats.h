@@ -0,0 +1,51 @@
+#ifndef OCTREE_STATS_H
+#define OCTREE_STATS_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Wall time of one step of getting a world ready, as timed by the caller.
+struct BuildPhase {
+    std::string name;
+    double milliseconds;
+};
+
+// What an octree holds and what it costs, from SparseVoxelOctree::Stats.
+// Node counts cover the nodes reachable from the root, each counted once
+// even in a merged tree; slots are every entry in the node array.
+struct OctreeStats {
+    int size = 0;
+    int maxDepth = 0;
+    bool merged = false;
+    size_t slots = 0;
+    size_t freeSlots = 0;        // On the free list, waiting for reuse
+    size_t unreachableSlots = 0; // Neither reachable nor free, e.g. lost races
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t interiorNodes = 0;
+    size_t emptyInteriorNodes = 0; // Interior nodes without children
+    size_t collapsedLeaves = 0;    // Leaves above maxDepth
+    std::vector<size_t> nodesPerDepth;  // Depth of first visit, breadth first
+    std::vector<size_t> leavesPerDepth;
+    double averageChildren = 0.0;  // Occupied child slots per interior node
+    // Bytes of the node and color arrays as uploaded, split by field.
+    size_t topologyBytes = 0;      // IsLeaf and childIndices
+    size_t colorBytes = 0;
+    size_t paddingBytes = 0;       // FlattenedNode::padding1
+    size_t arenaBytes = 0;         // Held by the arenas, spare block space included
+    // Distinct subtrees, colors included, and the share of reachable nodes a
+    // merge would remove; 0 if it wasn't counted.
+    size_t uniqueSubtrees = 0;
+    double duplicateRatio = 0.0;
+    std::vector<BuildPhase> phases;
+
+    size_t GpuBytes() const { return topologyBytes + colorBytes + paddingBytes; }
+    // Human-readable report, a line or table per group.
+    void Print(std::ostream& out) const;
+    // The same numbers as one JSON object.
+    std::string ToJson() const;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef OCTREE_UPLOADER_H
+#define OCTREE_UPLOADER_H
+
+#include <glad/glad.h>
+#include "Octree.h"
+#include "OctreeSnapshot.h"
+
+// Keeps the node and color SSBOs of an octree in step with it. The first
+// upload sends everything; later ones send only the ranges the octree
+// reports dirty, with glBufferSubData. The buffers are allocated with
+// headroom, so nodes appended by edits rarely force a full re-upload.
+class OctreeUploader {
+public:
+    OctreeUploader();
+    ~OctreeUploader();
+    OctreeUploader(const OctreeUploader&) = delete;
+    OctreeUploader& operator=(const OctreeUploader&) = delete;
+    // Returns the number of bytes sent.
+    size_t Upload(SparseVoxelOctree& octree);
+    // Uploads a published snapshot instead of the live tree. Chunks shared
+    // with the last snapshot uploaded are skipped, and the others are
+    // compared with it so only the pages that changed are sent. The writer
+    // can keep editing on another thread while this runs on the render
+    // thread.
+    size_t Upload(const std::shared_ptr<const OctreeSnapshot>& snapshot);
+    GLuint NodeBuffer() const { return m_nodeBuffer; }
+    GLuint ColorBuffer() const { return m_colorBuffer; }
+private:
+    size_t UploadRange(const SparseVoxelOctree& octree, size_t first, size_t count);
+    GLuint m_nodeBuffer = 0;
+    GLuint m_colorBuffer = 0;
+    size_t m_capacity = 0; // In nodes
+    std::shared_ptr<const OctreeSnapshot> m_lastSnapshot;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller doesn't say.
+inline int DefaultThreadCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : static_cast<int>(count);
+}
+
+// Runs body(i) for every i in [0, count) on up to threadCount threads, the
+// calling thread included. Indices are handed out one at a time, so uneven
+// work items balance themselves.
+template <typename Body>
+void ParallelFor(size_t count, int threadCount, Body body) {
+    size_t workers = std::min(count, static_cast<size_t>(std::max(threadCount, 1)));
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    auto run = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            body(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < workers; t++)
+        threads.emplace_back(run);
+    run();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Structure representing a color stop.
+struct ColorStop {
+    float height;      // The elevation at which this color applies.
+    glm::vec4 color;   // The color at this height.
+};
+
+// Given a noiseHeight and a sorted array of color stops, returns the interpolated color.
+glm::vec4 getMountainColor(float noiseHeight, const std::vector<ColorStop>& stops);
+
+// FNV-1a; pass a previous result as hash to chain several values.
+inline uint32_t HashBytes(const void* data, size_t size, uint32_t hash = 2166136261u) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// How each octave's noise is shaped before the octaves are added up.
+enum class NoiseShape {
+    Fbm,    // The noise as is: rolling hills
+    Ridged  // (1 - |noise|)^2: sharp crests where the noise crosses zero
+};
+
+// Layered noise: octaves summed at rising frequency and falling amplitude,
+// optionally sampled through a domain warp that first moves the position by
+// two more noise lookups.
+struct NoiseStack {
+    NoiseShape shape = NoiseShape::Fbm;
+    int octaves = 6;
+    float amplitude = 2.5f;     // Of the first octave
+    float frequency = 0.005f;   // Of the first octave
+    float persistence = 0.4f;   // Amplitude ratio between octaves
+    float lacunarity = 2.0f;    // Frequency ratio between octaves
+    float warpAmplitude = 0.0f; // World units; 0 turns the warp off
+    float warpFrequency = 0.01f;
+
+    // Multiplied out one octave at a time, the way the octave loop does it,
+    // so a constant folded stack gets the same bits.
+    constexpr float Frequency(int octave) const {
+        float f = frequency;
+        for (int i = 0; i < octave; i++)
+            f *= lacunarity;
+        return f;
+    }
+    constexpr float Amplitude(int octave) const {
+        float a = amplitude;
+        for (int i = 0; i < octave; i++)
+            a *= persistence;
+        return a;
+    }
+
+    // Hash of every parameter, chained onto hash, so a saved world can tell
+    // whether it was generated by this stack.
+    uint32_t Hash(uint32_t hash = 2166136261u) const {
+        int shapeValue = static_cast<int>(shape);
+        hash = HashBytes(&shapeValue, sizeof(shapeValue), hash);
+        hash = HashBytes(&octaves, sizeof(octaves), hash);
+        for (float value : {amplitude, frequency, persistence, lacunarity, warpAmplitude, warpFrequency})
+            hash = HashBytes(&value, sizeof(value), hash);
+        return hash;
+    }
+
+    // Limits on what the stack can return, in 2D or 3D. A single noise
+    // lookup blends corner gradients with weights in [0, 1], and each
+    // corner's value is two offsets in [-1, 1] added with signs, so it lies
+    // in [-2, 2]; a ridged octave lies in [0, 1]. The warp moves where the
+    // octaves are sampled, not what they return.
+    constexpr float Min() const {
+        float total = 0.0f;
+        for (int i = 0; i < octaves; i++)
+            total -= Reach(i) * (shape == NoiseShape::Ridged ? 0.0f : 2.0f);
+        return total;
+    }
+    constexpr float Max() const {
+        float total = 0.0f;
+        for (int i = 0; i < octaves; i++)
+            total += Reach(i) * (shape == NoiseShape::Ridged ? 1.0f : 2.0f);
+        return total;
+    }
+
+private:
+    constexpr float Reach(int octave) const {
+        float a = Amplitude(octave);
+        return a < 0.0f ? -a : a;
+    }
+};
+
+// The world's terrain: six octaves of fBm, each at twice the frequency and
+// 0.4 times the amplitude of the one before.
+struct TerrainNoise {
+    static constexpr NoiseStack Params{NoiseShape::Fbm, 6, 2.5f, 0.005f, 0.4f, 2.0f};
+};
+
+// 2D Perlin noise with a seeded permutation table, and the layered height
+// function the world is generated from.
+class TerrainGenerator {
+    private:
+        std::vector<int> perm;
+        int seed;
+
+        void initPermutation();
+
+        float fade(float t) const {
+            return t * t * t * (t * (t * 6 - 15) + 10);
+        }
+
+        // floor without the libm call, for coordinates that fit an int.
+        static int fastFloor(float t) {
+            int i = (int)t;
+            return t < (float)i ? i - 1 : i;
+        }
+
+        float lerp(float a, float b, float t) const {
+            return a + t * (b - a);
+        }
+
+        float grad(int hash, float x, float z) const {
+            int h = hash & 15;
+            float u = h < 8 ? x : z;
+            float v = h < 4 ? z : h == 12 || h == 14 ? x : 0;
+            return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+        }
+
+        // Ken Perlin's 3D gradient choice, twelve edges of a cube.
+        float grad(int hash, float x, float y, float z) const {
+            int h = hash & 15;
+            float u = h < 8 ? x : y;
+            float v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+            return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+        }
+
+        static float shapeOctave(NoiseShape shape, float noise) {
+            if (shape == NoiseShape::Ridged) {
+                float ridge = 1.0f - std::fabs(noise);
+                return ridge * ridge;
+            }
+            return noise;
+        }
+
+        // Moves (x, z) by the stack's domain warp. The offsets decorrelate
+        // the two lookups from each other and from the octaves.
+        void warp(float warpAmplitude, float warpFrequency, float& x, float& z) const {
+            float wx = x * warpFrequency;
+            float wz = z * warpFrequency;
+            float dx = getHeight(wx + 31.7f, wz + 47.3f);
+            float dz = getHeight(wx + 83.1f, wz + 12.9f);
+            x += dx * warpAmplitude;
+            z += dz * warpAmplitude;
+        }
+
+        template <typename Stack, int Octave>
+        float octave(float x, float z) const {
+            constexpr float frequency = Stack::Params.Frequency(Octave);
+            constexpr float amplitude = Stack::Params.Amplitude(Octave);
+            return shapeOctave(Stack::Params.shape, getHeight(x * frequency, z * frequency)) * amplitude;
+        }
+
+        template <typename Stack, int... Octave>
+        float sumOctaves(float x, float z, std::integer_sequence<int, Octave...>) const {
+            float total = 0.0f;
+            ((total += octave<Stack, Octave>(x, z)), ...);
+            return total;
+        }
+
+    public:
+        // Samples per call of the SIMD kernel behind the batch functions.
+        static const size_t BatchWidth = 8;
+
+        TerrainGenerator(int seed = 0) : seed(seed) {
+            initPermutation();
+        }
+
+        float getHeight(float x, float z) const {
+            int cellX = fastFloor(x);
+            int cellZ = fastFloor(z);
+            int X = cellX & 255;
+            int Z = cellZ & 255;
+            x -= (float)cellX;
+            z -= (float)cellZ;
+
+            float u = fade(x);
+            float v = fade(z);
+
+            int A = perm[X] + Z;
+            int AA = perm[A];
+            int AB = perm[A + 1];
+            int B = perm[X + 1] + Z;
+            int BA = perm[B];
+            int BB = perm[B + 1];
+
+            return lerp(lerp(grad(AA, x,   z),
+                           grad(BA, x-1, z),
+                           u),
+                    lerp(grad(AB, x,   z-1),
+                           grad(BB, x-1, z-1),
+                           u),
+                    v);
+        }
+
+        // 3D Perlin noise from the same permutation table.
+        float getNoise3(float x, float y, float z) const {
+            int cellX = fastFloor(x);
+            int cellY = fastFloor(y);
+            int cellZ = fastFloor(z);
+            int X = cellX & 255;
+            int Y = cellY & 255;
+            int Z = cellZ & 255;
+            x -= (float)cellX;
+            y -= (float)cellY;
+            z -= (float)cellZ;
+
+            float u = fade(x);
+            float v = fade(y);
+            float w = fade(z);
+
+            int A = perm[X] + Y;
+            int AA = perm[A] + Z;
+            int AB = perm[A + 1] + Z;
+            int B = perm[X + 1] + Y;
+            int BA = perm[B] + Z;
+            int BB = perm[B + 1] + Z;
+
+            return lerp(lerp(lerp(grad(perm[AA], x, y, z), grad(perm[BA], x - 1, y, z), u),
+                             lerp(grad(perm[AB], x, y - 1, z), grad(perm[BB], x - 1, y - 1, z), u), v),
+                        lerp(lerp(grad(perm[AA + 1], x, y, z - 1), grad(perm[BA + 1], x - 1, y, z - 1), u),
+                             lerp(grad(perm[AB + 1], x, y - 1, z - 1), grad(perm[BB + 1], x - 1, y - 1, z - 1), u), v),
+                        w);
+        }
+
+        // The layered noise of stack at (x, z). The parameters are read at
+        // run time, so they can be tuned live.
+        float getNoise(const NoiseStack& stack, float x, float z) const;
+
+        // The stack in 3D, built from getNoise3. The warp is applied to x
+        // and z only.
+        float getNoise(const NoiseStack& stack, float x, float y, float z) const;
+
+        // The 2D stack with its parameters fixed at compile time by
+        // Stack::Params, a constexpr NoiseStack: the octave loop is unrolled,
+        // every frequency and amplitude is a constant and the shape and warp
+        // are decided while compiling. Returns exactly what
+        // getNoise(Stack::Params, x, z) does.
+        template <typename Stack>
+        float getNoise(float x, float z) const {
+            if constexpr (Stack::Params.warpAmplitude != 0.0f)
+                warp(Stack::Params.warpAmplitude, Stack::Params.warpFrequency, x, z);
+            return sumOctaves<Stack>(x, z, std::make_integer_sequence<int, Stack::Params.octaves>());
+        }
+
+        // Terrain height: TerrainNoise scaled to world units.
+        float getY(float x, float z, float scale = 60.0f) const;
+
+        // getHeight and getY for count samples at (x[i], z[i]). Groups of
+        // BatchWidth go through an AVX2 kernel, with table lookups as gathers
+        // and the gradient choice as blends, when the CPU has it; the rest
+        // take the scalar path. The kernel does the scalar arithmetic in the
+        // same order and without fused multiply-adds, so the results match
+        // getHeight and getY exactly, not just within a tolerance.
+        void getHeights(const float* x, const float* z, float* out, size_t count) const;
+        void getYs(const float* x, const float* z, float* out, size_t count, float scale = 60.0f) const;
+};
+
+// Terrain heights and colors sampled on a dense square grid, for anything
+// that wants the surface without calling the noise: the octree builder,
+// minimaps, collision. Sample (ix, iz) lies at (ix * spacing, iz * spacing);
+// samples with the same ix are stored next to each other.
+class Heightfield {
+public:
+    // Fills a samples x samples grid. The grid is cut into tiles of
+    // tileSize x tileSize that threadCount workers take one at a time, each
+    // filling its tile with the batch noise a tile row at a time. The result
+    // doesn't depend on the thread count.
+    void Generate(const TerrainGenerator& terrain, int samples, float spacing, const std::vector<ColorStop>& stops,
+                  int threadCount, int tileSize = 64);
+
+    int Samples() const { return m_samples; }
+    float Spacing() const { return m_spacing; }
+    float Height(int ix, int iz) const { return m_heights[Index(ix, iz)]; }
+    // Packed RGBA8, as PackColor stores it.
+    uint32_t Color(int ix, int iz) const { return m_colors[Index(ix, iz)]; }
+    const std::vector<float>& Heights() const { return m_heights; }
+    const std::vector<uint32_t>& Colors() const { return m_colors; }
+    // Height at world (x, z), interpolated between the four nearest samples
+    // and clamped to the grid's edge.
+    float HeightAt(float x, float z) const;
+private:
+    size_t Index(int ix, int iz) const { return static_cast<size_t>(ix) * m_samples + iz; }
+
+    int m_samples = 0;
+    float m_spacing = 1.0f;
+    std::vector<float> m_heights;
+    std::vector<uint32_t> m_colors;
+};
+
+#endif
@@ -13,7 +13,9 @@
 #include <glm/gtc/type_ptr.hpp>
 class ComputeShader {
 public:
-    ComputeShader(const std::string& shaderPath);
+    // Each entry of defines is added as "#define <entry>" right after the
+    // #version line, so one source file can serve several configurations.
+    ComputeShader(const std::string& shaderPath, const std::vector<std::string>& defines = {});
     ~ComputeShader();
     void use();
     void dispatch(GLuint x, GLuint y = 1, GLuint z = 1);
@@ -67,8 +69,18 @@ private:
 };
 
 
-ComputeShader::ComputeShader(const std::string& shaderPath) {
+ComputeShader::ComputeShader(const std::string& shaderPath, const std::vector<std::string>& defines) {
     std::string source = loadShaderSource(shaderPath);
+    if (!defines.empty()) {
+        std::string block;
+        for (const std::string& define : defines)
+            block += "#define " + define + "\n";
+        size_t versionEnd = source.rfind("#version", 0) == 0 ? source.find('\n') : std::string::npos;
+        if (versionEnd == std::string::npos)
+            source.insert(0, block);
+        else
+            source.insert(versionEnd + 1, block);
+    }
     shaderID = glCreateShader(GL_COMPUTE_SHADER);
     const char* sourceCStr = source.c_str();
     glShaderSource(shaderID, 1, &sourceCStr, nullptr);
@@ -0,0 +1,595 @@
+#include "Benchmark.h"
+#include "BrickOctree.h"
+#include "CsgShape.h"
+#include "OctreeSnapshot.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Set-associative cache with LRU replacement, counting misses only.
+class CacheModel {
+public:
+    CacheModel(size_t bytes, int ways) : m_ways(ways) {
+        m_sets = std::max<size_t>(bytes / (LineBytes * ways), 1);
+        m_tags.assign(m_sets * ways, ~uint64_t(0));
+        m_stamps.assign(m_sets * ways, 0);
+    }
+    // Returns true on a hit.
+    bool Access(uint64_t line) {
+        size_t base = (line % m_sets) * m_ways;
+        m_clock++;
+        size_t victim = base;
+        for (int way = 0; way < m_ways; way++) {
+            if (m_tags[base + way] == line) {
+                m_stamps[base + way] = m_clock;
+                return true;
+            }
+            if (m_stamps[base + way] < m_stamps[victim])
+                victim = base + way;
+        }
+        m_tags[victim] = line;
+        m_stamps[victim] = m_clock;
+        m_misses++;
+        return false;
+    }
+    uint64_t Misses() const { return m_misses; }
+
+    static constexpr uint64_t LineBytes = 64;
+private:
+    size_t m_sets;
+    int m_ways;
+    std::vector<uint64_t> m_tags;
+    std::vector<uint64_t> m_stamps;
+    uint64_t m_clock = 0;
+    uint64_t m_misses = 0;
+};
+
+// Three levels sized like a desktop core; a miss goes on to the next level.
+struct CacheHierarchy {
+    CacheModel l1{32 * 1024, 8};
+    CacheModel l2{1024 * 1024, 16};
+    CacheModel l3{8 * 1024 * 1024, 16};
+    uint64_t reads = 0;
+
+    void Read(uint64_t address, size_t bytes) {
+        reads++;
+        uint64_t last = (address + bytes - 1) / CacheModel::LineBytes;
+        for (uint64_t line = address / CacheModel::LineBytes; line <= last; line++) {
+            if (!l1.Access(line) && !l2.Access(line))
+                l3.Access(line);
+        }
+    }
+};
+
+float MaxComponent(glm::vec3 v) {
+    return std::max(v.x, std::max(v.y, v.z));
+}
+
+float MinComponent(glm::vec3 v) {
+    return std::min(v.x, std::min(v.y, v.z));
+}
+
+// Colors are a separate buffer; give them their own address range.
+const uint64_t ColorBase = uint64_t(1) << 40;
+
+// Restart traversal: every sample descends from the root to the leaf or
+// empty cell holding it, then skips past that cell. This is what the
+// shader does, so the node access pattern matches the GPU's.
+template <typename Read>
+bool MarchRay(const SparseVoxelOctree& octree, glm::vec3 origin, glm::vec3 dir, Read read) {
+    const NodeArena<FlattenedNode>& nodes = octree.Nodes();
+    const std::vector<int>& halfSizes = octree.HalfSizes();
+    float size = static_cast<float>(octree.Size());
+    glm::vec3 invDir = 1.0f / dir;
+    glm::vec3 t0 = (glm::vec3(0.0f) - origin) * invDir;
+    glm::vec3 t1 = (glm::vec3(size) - origin) * invDir;
+    float tEnter = std::max(MaxComponent(glm::min(t0, t1)), 0.0f);
+    float tExit = MinComponent(glm::max(t0, t1));
+    float t = tEnter;
+    for (int step = 0; step < 1024 && t < tExit; step++) {
+        glm::ivec3 point = glm::clamp(glm::ivec3(glm::floor(origin + dir * t)), glm::ivec3(0), glm::ivec3(octree.Size() - 1));
+        int nodeIndex = 0;
+        glm::ivec3 lo(0), hi(octree.Size());
+        for (int depth = 0;; depth++) {
+            read(static_cast<uint64_t>(nodeIndex) * sizeof(FlattenedNode), sizeof(FlattenedNode));
+            const FlattenedNode& node = nodes[nodeIndex];
+            if (node.IsLeaf) {
+                read(ColorBase + static_cast<uint64_t>(nodeIndex) * sizeof(uint32_t), sizeof(uint32_t));
+                return true;
+            }
+            if (depth == octree.MaxDepth())
+                break;
+            int half = halfSizes[depth];
+            glm::ivec3 position = lo;
+            int octant = SparseVoxelOctree::ChildOctant(point, position, half);
+            glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+            hi = glm::mix(lo + glm::ivec3(half), hi, glm::equal(offset, glm::ivec3(1)));
+            lo = position;
+            nodeIndex = node.childIndices[octant];
+            if (nodeIndex == -1)
+                break;
+        }
+        // Leave the empty cell [lo, hi) through its nearest face.
+        glm::vec3 c0 = (glm::vec3(lo) - origin) * invDir;
+        glm::vec3 c1 = (glm::vec3(hi) - origin) * invDir;
+        t = std::max(MinComponent(glm::max(c0, c1)), t) + 1e-3f;
+    }
+    return false;
+}
+
+// A few views around the terrain, looking down at the middle of the cube.
+std::vector<std::pair<glm::vec3, glm::vec3>> BenchmarkRays(const SparseVoxelOctree& octree) {
+    const int width = 320, height = 180, views = 4;
+    float size = static_cast<float>(octree.Size());
+    glm::vec3 target(size * 0.5f, size * 0.05f, size * 0.5f);
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+    rays.reserve(width * height * views);
+    for (int view = 0; view < views; view++) {
+        float angle = view * 1.5707963f + 0.4f;
+        glm::vec3 eye = target + glm::vec3(std::cos(angle) * size * 0.45f, size * 0.25f, std::sin(angle) * size * 0.45f);
+        glm::vec3 forward = glm::normalize(target - eye);
+        glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up = glm::cross(right, forward);
+        float scale = std::tan(glm::radians(45.0f) * 0.5f);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float u = (2.0f * (x + 0.5f) / width - 1.0f) * scale * width / height;
+                float v = (1.0f - 2.0f * (y + 0.5f) / height) * scale;
+                glm::vec3 dir = glm::normalize(forward + u * right + v * up);
+                // Keep the slab tests away from infinities.
+                dir = glm::mix(dir, glm::vec3(1e-6f), glm::equal(dir, glm::vec3(0.0f)));
+                rays.emplace_back(eye, dir);
+            }
+        }
+    }
+    return rays;
+}
+
+// Number of set bits, for Raycast8's hit mask.
+int PopCount(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(bits);
+#else
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        count++;
+    return count;
+#endif
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename T>
+bool SameArena(const NodeArena<T>& a, const NodeArena<T>& b) {
+    if (a.size() != b.size())
+        return false;
+    bool same = true;
+    a.ForEachBlock([&](const T* data, size_t first, size_t count) {
+        same = same && std::memcmp(data, &b[first], count * sizeof(T)) == 0;
+    });
+    return same;
+}
+
+// Query points scattered around the surface, where gameplay asks.
+std::vector<glm::ivec3> SurfacePoints(const SparseVoxelOctree& octree, size_t count) {
+    std::mt19937 random(99);
+    std::vector<glm::ivec3> points;
+    points.reserve(count);
+    while (points.size() < count) {
+        glm::ivec3 column(random() % octree.Size(), octree.Size() - 1, random() % octree.Size());
+        int height;
+        if (octree.FindGround(column, &height))
+            points.push_back(glm::ivec3(column.x, height + static_cast<int>(random() % 17) - 8, column.z));
+    }
+    return points;
+}
+
+// Stacks for the noise benchmark besides the terrain's own.
+struct OneOctave {
+    static constexpr NoiseStack Params{NoiseShape::Fbm, 1};
+};
+struct RidgedNoise {
+    static constexpr NoiseStack Params{NoiseShape::Ridged, 8, 1.0f, 0.004f, 0.5f, 2.0f};
+};
+struct WarpedNoise {
+    static constexpr NoiseStack Params{NoiseShape::Fbm, 8, 1.0f, 0.004f, 0.5f, 2.0f, 40.0f, 0.002f};
+};
+
+} // namespace
+
+void RunLayoutBenchmark(SparseVoxelOctree& octree) {
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays = BenchmarkRays(octree);
+    std::cout << "Layout benchmark: " << rays.size() << " rays, " << octree.Nodes().size() << " nodes" << std::endl;
+    std::printf("%-14s %10s %10s %10s %10s %10s\n", "layout", "reads/ray", "L1/ray", "L2/ray", "L3/ray", "ms");
+    auto measure = [&](const char* name) {
+        CacheHierarchy caches;
+        size_t hits = 0;
+        for (const auto& ray : rays)
+            hits += MarchRay(octree, ray.first, ray.second, [&](uint64_t address, size_t bytes) { caches.Read(address, bytes); });
+
+        // Timed separately, without the cache model in the loop.
+        auto start = std::chrono::steady_clock::now();
+        size_t timedHits = 0;
+        for (const auto& ray : rays)
+            timedHits += MarchRay(octree, ray.first, ray.second, [](uint64_t, size_t) {});
+        double ms = MillisecondsSince(start);
+
+        double perRay = 1.0 / rays.size();
+        std::printf("%-14s %10.2f %10.2f %10.2f %10.2f %10.1f\n", name, caches.reads * perRay,
+                    caches.l1.Misses() * perRay, caches.l2.Misses() * perRay, caches.l3.Misses() * perRay, ms);
+        if (timedHits != hits)
+            std::cout << "Hit count changed between runs" << std::endl;
+    };
+
+    // The tree as it came in (insertion order unless it was built or
+    // reordered), then each layout.
+    measure("current");
+    struct Entry {
+        NodeLayout layout;
+        const char* name;
+    };
+    const Entry layouts[] = {
+        {NodeLayout::BreadthFirst, "breadth-first"},
+        {NodeLayout::DepthFirst, "depth-first"},
+        {NodeLayout::VanEmdeBoas, "van Emde Boas"},
+    };
+    for (const Entry& entry : layouts) {
+        octree.Reorder(entry.layout);
+        measure(entry.name);
+    }
+    octree.Reorder(NodeLayout::BreadthFirst);
+}
+
+void RunQueryBenchmark(const SparseVoxelOctree& octree) {
+    const int count = 100000;
+    std::vector<glm::ivec3> points = SurfacePoints(octree, count);
+    std::cout << "Query benchmark: " << count << " points near the surface, " << octree.Nodes().size() << " nodes" << std::endl;
+    std::printf("%-22s %10s %12s\n", "query", "ns/query", "result/query");
+
+    // result sums what each query found, so the work can't be skipped and
+    // the rows say how much each query returned.
+    auto measure = [&](const char* name, auto query) {
+        auto start = std::chrono::steady_clock::now();
+        size_t result = 0;
+        for (const glm::ivec3& point : points)
+            result += query(point);
+        double ms = MillisecondsSince(start);
+        std::printf("%-22s %10.1f %12.2f\n", name, ms * 1e6 / count, static_cast<double>(result) / count);
+    };
+    measure("Lookup", [&](glm::ivec3 point) {
+        glm::vec4 color;
+        return octree.Lookup(point, &color) ? size_t(1) : size_t(0);
+    });
+    measure("ForEachLeafInBox 8^3", [&](glm::ivec3 point) {
+        size_t leaves = 0;
+        octree.ForEachLeafInBox(point - 4, point + 3, [&](glm::ivec3, glm::ivec3, uint32_t) { leaves++; });
+        return leaves;
+    });
+    measure("ForEachLeafInBox 32^3", [&](glm::ivec3 point) {
+        size_t leaves = 0;
+        octree.ForEachLeafInBox(point - 16, point + 15, [&](glm::ivec3, glm::ivec3, uint32_t) { leaves++; });
+        return leaves;
+    });
+    measure("FindGround", [&](glm::ivec3 point) {
+        int height;
+        return octree.FindGround(point + glm::ivec3(0, 64, 0), &height) ? size_t(1) : size_t(0);
+    });
+    SparseVoxelOctree::NearestVoxel nearest[8];
+    measure("FindNearest k=1", [&](glm::ivec3 point) {
+        return octree.FindNearest(glm::vec3(point) + 0.5f, 64.0f, nearest, 1);
+    });
+    measure("FindNearest k=8", [&](glm::ivec3 point) {
+        return octree.FindNearest(glm::vec3(point) + 0.5f, 64.0f, nearest, 8);
+    });
+}
+
+void RunBrickBenchmark(const SparseVoxelOctree& octree) {
+    const int count = 100000;
+    std::vector<glm::ivec3> points = SurfacePoints(octree, count);
+    size_t flatBytes = octree.Nodes().size() * sizeof(FlattenedNode) + octree.Colors().size() * sizeof(uint32_t);
+    std::cout << "Brick benchmark: " << count << " lookups near the surface" << std::endl;
+    std::printf("%-12s %12s %10s %10s %12s %10s\n", "tree", "bytes", "build ms", "ns/lookup", "voxels ms", "mismatch");
+
+    // found sums the hits, so the lookups can't be skipped.
+    std::vector<bool> expected(count);
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < count; i++) {
+        glm::vec4 color;
+        expected[i] = octree.Lookup(points[i], &color);
+        found += expected[i];
+    }
+    double flatNs = MillisecondsSince(start) * 1e6 / count;
+    std::printf("%-12s %12zu %10s %10.1f %12s %10s\n", "flat", flatBytes, "-", flatNs, "-", "-");
+
+    for (int levels = 2; levels <= 3; levels++) {
+        start = std::chrono::steady_clock::now();
+        BrickOctree bricks(octree, levels);
+        double buildMs = MillisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        size_t mismatches = 0;
+        for (int i = 0; i < count; i++) {
+            glm::vec4 color;
+            bool hit = bricks.Lookup(points[i], &color);
+            found += hit;
+            mismatches += hit != expected[i];
+        }
+        double lookupNs = MillisecondsSince(start) * 1e6 / count;
+        start = std::chrono::steady_clock::now();
+        size_t voxels = 0;
+        bricks.ForEachVoxel([&](glm::ivec3, uint32_t) { voxels++; });
+        double visitMs = MillisecondsSince(start);
+        found += voxels;
+        char name[16];
+        std::snprintf(name, sizeof(name), "bricks %d^3", 1 << levels);
+        std::printf("%-12s %12zu %10.1f %10.1f %12.1f %10zu\n", name, bricks.MemoryUsage(), buildMs, lookupNs, visitMs,
+                    mismatches);
+    }
+    std::printf("checksum %zu\n", found);
+}
+
+void RunRaycastBenchmark(const SparseVoxelOctree& octree) {
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays = BenchmarkRays(octree);
+    rays.resize(rays.size() / 8 * 8);
+    const float maxDistance = 1e9f;
+    std::cout << "Raycast benchmark: " << rays.size() << " rays, " << octree.Nodes().size() << " nodes" << std::endl;
+    std::printf("%-14s %10s %10s %10s\n", "traversal", "ms", "Mrays/s", "hits");
+    auto report = [&](const char* name, double ms, size_t hits) {
+        std::printf("%-14s %10.1f %10.2f %10zu\n", name, ms, rays.size() / (ms * 1000.0), hits);
+    };
+
+    std::vector<RayHit> scalar(rays.size());
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+        hits += octree.Raycast(rays[i].first, rays[i].second, maxDistance, &scalar[i]);
+    report("scalar", MillisecondsSince(start), hits);
+
+    // Each packet is a 4x2 tile of neighbouring pixels; the rays are stored
+    // row by row, 320 to a row.
+    std::vector<RayPacket> packets(rays.size() / 8);
+    std::vector<size_t> rayOf(rays.size());
+    for (size_t i = 0; i < rays.size(); i++) {
+        size_t row = i / 320, column = i % 320;
+        size_t tile = (row / 2) * 80 + column / 4;
+        size_t lane = (row % 2) * 4 + column % 4;
+        rayOf[tile * 8 + lane] = i;
+        RayPacket& packet = packets[tile];
+        packet.originX[lane] = rays[i].first.x;
+        packet.originY[lane] = rays[i].first.y;
+        packet.originZ[lane] = rays[i].first.z;
+        packet.directionX[lane] = rays[i].second.x;
+        packet.directionY[lane] = rays[i].second.y;
+        packet.directionZ[lane] = rays[i].second.z;
+        packet.maxDistance[lane] = maxDistance;
+    }
+    std::vector<RayHit> packed(rays.size());
+    start = std::chrono::steady_clock::now();
+    hits = 0;
+    for (size_t i = 0; i < packets.size(); i++)
+        hits += PopCount(octree.Raycast8(packets[i], &packed[i * 8]));
+    report("packet of 8", MillisecondsSince(start), hits);
+
+    start = std::chrono::steady_clock::now();
+    hits = 0;
+    for (const auto& ray : rays)
+        hits += MarchRay(octree, ray.first, ray.second, [](uint64_t, size_t) {});
+    report("restart march", MillisecondsSince(start), hits);
+
+    // Rays that hit where leaves meet may report either one.
+    size_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        const RayHit& a = scalar[rayOf[i]];
+        const RayHit& b = packed[i];
+        if ((a.nodeIndex == -1) != (b.nodeIndex == -1) || a.distance != b.distance)
+            mismatches++;
+    }
+    if (mismatches > 0)
+        std::cout << mismatches << " rays differ between scalar and packet traversal" << std::endl;
+}
+
+void RunNoiseBenchmark(const TerrainGenerator& terrain) {
+    // A square of the world at one sample per unit, like a heightfield.
+    const int side = 512;
+    const size_t count = static_cast<size_t>(side) * side;
+    std::cout << "Noise benchmark: " << count << " samples per stack" << std::endl;
+    std::printf("%-12s %7s %14s %14s %14s %8s\n", "stack", "octaves", "run time ns", "compiled ns", "ns/octave", "match");
+
+    // checksum keeps the loops from being thrown away.
+    double checksum = 0.0;
+    auto time = [&](auto sample, std::vector<float>& out) {
+        auto start = std::chrono::steady_clock::now();
+        for (int ix = 0; ix < side; ix++) {
+            for (int iz = 0; iz < side; iz++)
+                out[static_cast<size_t>(ix) * side + iz] = sample(static_cast<float>(ix), static_cast<float>(iz));
+        }
+        double ms = MillisecondsSince(start);
+        for (float value : out)
+            checksum += value;
+        return ms * 1e6 / count;
+    };
+    auto measure = [&](const char* name, auto stack) {
+        using Stack = decltype(stack);
+        // Copied so the run time path can't see the constants.
+        NoiseStack params = Stack::Params;
+        std::vector<float> runtime(count), compiled(count);
+        double runtimeNs = time([&](float x, float z) { return terrain.getNoise(params, x, z); }, runtime);
+        double compiledNs = time([&](float x, float z) { return terrain.getNoise<Stack>(x, z); }, compiled);
+        bool match = std::memcmp(runtime.data(), compiled.data(), count * sizeof(float)) == 0;
+        std::printf("%-12s %7d %14.1f %14.1f %14.2f %8s\n", name, params.octaves, runtimeNs, compiledNs,
+                    compiledNs / params.octaves, match ? "yes" : "NO");
+    };
+    measure("one octave", OneOctave());
+    measure("terrain", TerrainNoise());
+    measure("ridged", RidgedNoise());
+    measure("warped", WarpedNoise());
+
+    // The terrain also has a batch path, used by Heightfield.
+    std::vector<float> x(count), z(count), out(count);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = static_cast<float>(i / side);
+        z[i] = static_cast<float>(i % side);
+    }
+    auto start = std::chrono::steady_clock::now();
+    terrain.getYs(x.data(), z.data(), out.data(), count, 1.0f);
+    double batchNs = MillisecondsSince(start) * 1e6 / count;
+    for (float value : out)
+        checksum += value;
+    std::printf("%-12s %7d %14s %14.1f %14.2f\n", "terrain getYs", TerrainNoise::Params.octaves, "-", batchNs,
+                batchNs / TerrainNoise::Params.octaves);
+    std::printf("checksum %.3f\n", checksum);
+}
+
+bool RunConcurrentInsertCheck(const std::vector<Voxel>& terrain, int size, int maxDepth, int threadCount) {
+    std::vector<Voxel> voxels = terrain;
+    std::mt19937 random(1234);
+    auto coord = [&](int range) { return static_cast<float>(random() % range); };
+    // Trees: a trunk column with a ball of leaves on top of a terrain voxel.
+    for (int i = 0; i < 4000 && !terrain.empty(); i++) {
+        glm::vec3 base = terrain[random() % terrain.size()].position;
+        int height = 6 + random() % 10;
+        for (int y = 1; y <= height; y++)
+            voxels.push_back({base + glm::vec3(0.0f, y, 0.0f), glm::vec4(0.4f, 0.25f, 0.1f, 1.0f)});
+        for (int z = -3; z <= 3; z++)
+            for (int y = -3; y <= 3; y++)
+                for (int x = -3; x <= 3; x++)
+                    if (x * x + y * y + z * z <= 9)
+                        voxels.push_back({base + glm::vec3(x, height + y, z), glm::vec4(0.1f, 0.6f, 0.1f, 1.0f)});
+    }
+    // Structures: hollow boxes anywhere in the cube.
+    for (int i = 0; i < 200; i++) {
+        glm::vec3 corner(coord(size), coord(size), coord(size));
+        glm::vec3 extent(4 + coord(24), 4 + coord(24), 4 + coord(24));
+        for (float z = 0; z <= extent.z; z++)
+            for (float y = 0; y <= extent.y; y++)
+                for (float x = 0; x <= extent.x; x++)
+                    if (x == 0 || y == 0 || z == 0 || x == extent.x || y == extent.y || z == extent.z)
+                        voxels.push_back({corner + glm::vec3(x, y, z), glm::vec4(0.5f, 0.5f, 0.55f, 1.0f)});
+    }
+
+    SparseVoxelOctree reference(size, maxDepth);
+    // Voxels sharing a leaf get one color, so the leaf doesn't depend on
+    // which thread writes last.
+    for (Voxel& voxel : voxels) {
+        uint64_t key = reference.MortonKey(glm::ivec3(voxel.position));
+        voxel.color = UnpackColor(static_cast<uint32_t>(key * 0x9E3779B97F4A7C15ull >> 32) | 0xFF000000u);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (const Voxel& voxel : voxels)
+        reference.Insert(voxel.position, voxel.color);
+    double serialMs = MillisecondsSince(start);
+    // Interior colors are timing dependent in the concurrent tree; filtering
+    // both from their leaves makes them comparable.
+    reference.FilterColors(ColorFilter::Average);
+    reference.Reorder(NodeLayout::BreadthFirst);
+    std::cout << "Concurrent insert check: " << voxels.size() << " voxels, serial insert " << serialMs << " ms" << std::endl;
+
+    bool passed = true;
+    for (int round = 0; round < 4; round++) {
+        int threads = std::max(2, threadCount >> (round & 1));
+        SparseVoxelOctree octree(size, maxDepth);
+        start = std::chrono::steady_clock::now();
+        octree.BeginConcurrentInsert();
+        ParallelFor(threads, threads, [&](size_t thread) {
+            for (size_t i = thread; i < voxels.size(); i += threads)
+                octree.InsertConcurrent(voxels[i].position, voxels[i].color);
+        });
+        octree.EndConcurrentInsert();
+        double concurrentMs = MillisecondsSince(start);
+        octree.FilterColors(ColorFilter::Average);
+        octree.Reorder(NodeLayout::BreadthFirst);
+        bool same = SameArena(octree.Nodes(), reference.Nodes()) && SameArena(octree.Colors(), reference.Colors());
+        std::cout << "  round " << round << ": " << threads << " threads, " << concurrentMs << " ms, "
+                  << (same ? "matches" : "DIFFERS") << std::endl;
+        passed = passed && same;
+    }
+    return passed;
+}
+
+bool RunSnapshotCheck(SparseVoxelOctree& octree, int threadCount) {
+    if (octree.IsMerged()) {
+        std::cout << "Snapshot check needs an editable octree, run it without --merge" << std::endl;
+        return false;
+    }
+    std::vector<glm::ivec3> points = SurfacePoints(octree, 4096);
+    octree.Publish();
+
+    // Readers look every point up twice in the snapshot they pinned; the
+    // writer publishes in between, which must not show through.
+    std::atomic<bool> done(false);
+    std::atomic<size_t> readerRounds(0);
+    std::atomic<size_t> readerMismatches(0);
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < std::max(threadCount - 1, 1); reader++) {
+        readers.emplace_back([&] {
+            std::vector<int64_t> seen(points.size());
+            auto lookup = [&](const OctreeSnapshot& snapshot, size_t i) {
+                glm::vec4 color;
+                return snapshot.Lookup(points[i], &color) ? static_cast<int64_t>(PackColor(color)) : -1;
+            };
+            while (!done) {
+                std::shared_ptr<const OctreeSnapshot> pinned = octree.Snapshot();
+                for (size_t i = 0; i < points.size(); i++)
+                    seen[i] = lookup(*pinned, i);
+                size_t mismatches = 0;
+                for (size_t i = 0; i < points.size(); i++)
+                    mismatches += lookup(*pinned, i) != seen[i];
+                readerMismatches += mismatches;
+                readerRounds++;
+            }
+        });
+    }
+
+    std::mt19937 random(4321);
+    const int edits = 64;
+    bool passed = true;
+    size_t copiedChunks = 0;
+    size_t totalChunks = 0;
+    double publishMs = 0.0;
+    for (int edit = 0; edit < edits; edit++) {
+        glm::vec3 center(points[random() % points.size()]);
+        float radius = 2.0f + static_cast<float>(random() % 6);
+        if (edit % 4 == 3)
+            octree.Combine(CsgShape::Sphere(center, radius), CsgOp::Union, glm::vec4(0.8f, 0.3f, 0.2f, 1.0f));
+        else
+            octree.Combine(CsgShape::Sphere(center, radius), CsgOp::Subtract);
+        std::shared_ptr<const OctreeSnapshot> previous = octree.Snapshot();
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const OctreeSnapshot> published = octree.Publish();
+        publishMs += MillisecondsSince(start);
+
+        for (size_t chunk = 0; chunk < published->ChunkCount(); chunk++) {
+            if (chunk >= previous->ChunkCount() || published->NodeChunkAt(chunk) != previous->NodeChunkAt(chunk))
+                copiedChunks++;
+        }
+        totalChunks += published->ChunkCount();
+        bool same = published->NodeCount() == octree.Nodes().size();
+        for (size_t i = 0; same && i < published->NodeCount(); i++) {
+            same = std::memcmp(&published->Node(i), &octree.Nodes()[i], sizeof(FlattenedNode)) == 0 &&
+                   published->Color(i) == octree.Colors()[i];
+        }
+        if (!same)
+            std::cout << "  edit " << edit << ": published snapshot DIFFERS from the live tree" << std::endl;
+        passed = passed && same;
+    }
+    done = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    std::cout << "Snapshot check: " << edits << " edits, " << publishMs / edits << " ms per publish, copied "
+              << copiedChunks << " of " << totalChunks << " chunks" << std::endl;
+    std::cout << "  " << readers.size() << " readers, " << readerRounds.load() << " pinned snapshots, "
+              << readerMismatches.load() << " lookups changed under a reader" << std::endl;
+    return passed && readerMismatches == 0;
+}
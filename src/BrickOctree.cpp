@@ -0,0 +1,147 @@
+#include "BrickOctree.h"
+#include <algorithm>
+
+BrickOctree::BrickOctree(const SparseVoxelOctree& octree, int brickLevels)
+    : m_halfSizes(octree.HalfSizes()), m_maxDepth(octree.MaxDepth()) {
+    m_brickLevels = std::min(std::max(brickLevels, 0), std::min(m_maxDepth, 3));
+    m_brickDepth = m_maxDepth - m_brickLevels;
+    m_brickSide = 1 << m_brickLevels;
+    int brickVoxels = m_brickSide * m_brickSide * m_brickSide;
+    m_wordsPerBrick = (brickVoxels + 63) / 64;
+
+    // The integer split makes voxel widths uneven, so a voxel's corner inside
+    // a brick is the sum of the child offsets its coordinate bits select.
+    m_localOffsets.assign(m_brickSide, 0);
+    for (int v = 0; v < m_brickSide; v++) {
+        for (int level = 0; level < m_brickLevels; level++) {
+            if ((v >> (m_brickLevels - 1 - level)) & 1)
+                m_localOffsets[v] += m_halfSizes[m_brickDepth + level];
+        }
+    }
+
+    // Copy the node levels above the cut-off breadth first; every source node
+    // reaching the cut-off depth becomes a brick.
+    const NodeArena<FlattenedNode>& sourceNodes = octree.Nodes();
+    const NodeArena<uint32_t>& sourceColors = octree.Colors();
+    struct Pending {
+        int source;
+        int depth;
+    };
+    std::vector<Pending> queue;
+    queue.push_back({0, 0});
+    m_nodes.push_back(FlattenedNode());
+    std::vector<uint32_t> voxelColors(brickVoxels);
+    std::vector<bool> voxelSet(brickVoxels);
+    for (size_t i = 0; i < queue.size(); i++) {
+        Pending pending = queue[i];
+        const FlattenedNode& source = sourceNodes[pending.source];
+        FlattenedNode node;
+        m_colors.push_back(sourceColors[pending.source]);
+        if (source.IsLeaf) {
+            node.IsLeaf = true;
+        } else if (pending.depth == m_brickDepth) {
+            // Rasterise the subtree into the brick; a leaf above the voxel
+            // level fills its whole sub-cube.
+            std::fill(voxelSet.begin(), voxelSet.end(), false);
+            struct Entry {
+                int source;
+                int level;
+                glm::ivec3 local;
+            };
+            Entry stack[8 * 4];
+            int stackSize = 0;
+            stack[stackSize++] = {pending.source, 0, glm::ivec3(0)};
+            while (stackSize > 0) {
+                Entry entry = stack[--stackSize];
+                const FlattenedNode& inner = sourceNodes[entry.source];
+                int side = m_brickSide >> entry.level;
+                if (inner.IsLeaf || entry.level == m_brickLevels) {
+                    for (int z = 0; z < side; z++)
+                        for (int y = 0; y < side; y++)
+                            for (int x = 0; x < side; x++) {
+                                int bit = BitIndex(entry.local.x + x, entry.local.y + y, entry.local.z + z);
+                                voxelSet[bit] = true;
+                                voxelColors[bit] = sourceColors[entry.source];
+                            }
+                    continue;
+                }
+                for (int octant = 0; octant < 8; octant++) {
+                    int child = inner.childIndices[octant];
+                    if (child == -1)
+                        continue;
+                    glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+                    stack[stackSize++] = {child, entry.level + 1, entry.local + offset * (side / 2)};
+                }
+            }
+
+            node.IsLeaf = true;
+            node.childIndices[0] = static_cast<int>(m_colorOffsets.size());
+            m_colorOffsets.push_back(static_cast<uint32_t>(m_brickColors.size()));
+            m_occupancy.resize(m_occupancy.size() + m_wordsPerBrick, 0);
+            uint64_t* words = &m_occupancy[m_occupancy.size() - m_wordsPerBrick];
+            for (int bit = 0; bit < brickVoxels; bit++) {
+                if (!voxelSet[bit])
+                    continue;
+                words[bit >> 6] |= uint64_t(1) << (bit & 63);
+                m_brickColors.push_back(voxelColors[bit]);
+            }
+        } else {
+            for (int octant = 0; octant < 8; octant++) {
+                int child = source.childIndices[octant];
+                if (child == -1)
+                    continue;
+                node.childIndices[octant] = static_cast<int>(queue.size());
+                queue.push_back({child, pending.depth + 1});
+                m_nodes.push_back(FlattenedNode());
+            }
+        }
+        m_nodes[i] = node;
+    }
+}
+
+uint32_t BrickOctree::ColorIndex(int brick, int bit) const {
+    const uint64_t* words = &m_occupancy[brick * m_wordsPerBrick];
+    uint32_t index = m_colorOffsets[brick];
+    for (int word = 0; word < (bit >> 6); word++)
+        index += PopCount(words[word]);
+    return index + PopCount(words[bit >> 6] & ((uint64_t(1) << (bit & 63)) - 1));
+}
+
+bool BrickOctree::Lookup(glm::ivec3 point, glm::vec4* color) const {
+    int nodeIndex = 0;
+    glm::ivec3 position(0);
+    for (int depth = 0; depth <= m_brickDepth; depth++) {
+        const FlattenedNode& node = m_nodes[nodeIndex];
+        if (node.IsLeaf) {
+            int brick = node.childIndices[0];
+            if (brick == -1) {
+                if (color)
+                    *color = UnpackColor(m_colors[nodeIndex]);
+                return true;
+            }
+            glm::ivec3 local(0);
+            for (int level = 0; level < m_brickLevels; level++) {
+                int octant = SparseVoxelOctree::ChildOctant(point, position, m_halfSizes[depth + level]);
+                local = local * 2 + glm::ivec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+            }
+            int bit = BitIndex(local.x, local.y, local.z);
+            if (!TestBit(brick, bit))
+                return false;
+            if (color)
+                *color = UnpackColor(m_brickColors[ColorIndex(brick, bit)]);
+            return true;
+        }
+        if (depth == m_brickDepth)
+            break;
+        nodeIndex = node.childIndices[SparseVoxelOctree::ChildOctant(point, position, m_halfSizes[depth])];
+        if (nodeIndex == -1)
+            break;
+    }
+    return false;
+}
+
+size_t BrickOctree::MemoryUsage() const {
+    return m_nodes.size() * sizeof(FlattenedNode) + m_colors.size() * sizeof(uint32_t) +
+           m_occupancy.size() * sizeof(uint64_t) + m_colorOffsets.size() * sizeof(uint32_t) +
+           m_brickColors.size() * sizeof(uint32_t);
+}
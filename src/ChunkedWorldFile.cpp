@@ -0,0 +1,389 @@
+#include "ChunkedWorldFile.h"
+#include "Compression.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+bool CoordLess(glm::ivec3 a, glm::ivec3 b) {
+    if (a.x != b.x)
+        return a.x < b.x;
+    if (a.y != b.y)
+        return a.y < b.y;
+    return a.z < b.z;
+}
+
+glm::ivec3 ChildCoord(glm::ivec3 coord, int octant) {
+    return coord * 2 + glm::ivec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+}
+
+// Encodes the subtree under one node as a record, uncompressed. The top
+// record stops above chunkDepth and collects the chunk roots instead.
+class RecordWriter {
+public:
+    RecordWriter(const SparseVoxelOctree& octree, int chunkDepth, bool shared)
+        : m_octree(octree), m_chunkDepth(chunkDepth), m_shared(shared) {}
+
+    void Write(int node, int depth, glm::ivec3 coord) {
+        if (m_shared)
+            m_listed[node] = m_count;
+        m_count++;
+        const FlattenedNode& flattened = m_octree.Nodes()[node];
+        uint8_t mask = 0;
+        for (int octant = 0; octant < 8; octant++) {
+            if (flattened.childIndices[octant] != -1)
+                mask |= 1 << octant;
+        }
+        m_topology.push_back(flattened.IsLeaf ? 1 : 0);
+        m_topology.push_back(mask);
+        uint32_t color = m_octree.Colors()[node];
+        for (int shift = 0; shift < 32; shift += 8)
+            m_colors.push_back(static_cast<uint8_t>((color >> shift) - (m_previousColor >> shift)));
+        m_previousColor = color;
+
+        for (int octant = 0; octant < 8; octant++) {
+            int child = flattened.childIndices[octant];
+            if (child == -1)
+                continue;
+            if (depth + 1 == m_chunkDepth) {
+                m_chunkRoots.push_back({ChildCoord(coord, octant), child});
+                continue;
+            }
+            if (m_shared) {
+                auto listed = m_listed.find(child);
+                if (listed != m_listed.end()) {
+                    WriteVarint(m_topology, m_count - listed->second);
+                    continue;
+                }
+                WriteVarint(m_topology, 0);
+            }
+            Write(child, depth + 1, ChildCoord(coord, octant));
+        }
+    }
+
+    // Topology followed by colors.
+    std::vector<uint8_t> Finish() {
+        m_topology.insert(m_topology.end(), m_colors.begin(), m_colors.end());
+        return std::move(m_topology);
+    }
+
+    uint32_t NodeCount() const { return m_count; }
+    std::vector<std::pair<glm::ivec3, int>>& ChunkRoots() { return m_chunkRoots; }
+
+private:
+    const SparseVoxelOctree& m_octree;
+    int m_chunkDepth; // -1 in chunk records, which never stop
+    bool m_shared;
+    std::vector<uint8_t> m_topology;
+    std::vector<uint8_t> m_colors;
+    std::unordered_map<int, uint32_t> m_listed; // Node to its position in the record
+    std::vector<std::pair<glm::ivec3, int>> m_chunkRoots;
+    uint32_t m_count = 0;
+    uint32_t m_previousColor = 0;
+};
+
+struct Record {
+    std::vector<uint8_t> data; // Compressed
+    uint32_t rawLength = 0;
+    uint32_t nodeCount = 0;
+    uint64_t offset = 0;
+};
+
+Record Compress(RecordWriter& writer) {
+    Record record;
+    record.nodeCount = writer.NodeCount();
+    std::vector<uint8_t> raw = writer.Finish();
+    record.rawLength = static_cast<uint32_t>(raw.size());
+    LzCompress(raw.data(), raw.size(), record.data);
+    return record;
+}
+
+} // namespace
+
+bool ChunkedWorldFile::Save(const SparseVoxelOctree& octree, const std::string& path, uint32_t seed,
+                            uint32_t generator, int chunkDepth, int threadCount) {
+    if (octree.MaxDepth() < 1 || octree.MaxDepth() > 63) {
+        std::cout << "Can't save an octree of depth " << octree.MaxDepth() << " in chunks" << std::endl;
+        return false;
+    }
+    chunkDepth = std::max(1, std::min(chunkDepth, octree.MaxDepth()));
+
+    // The top is written out in full even in a merged tree, so every chunk
+    // is reachable by its coordinate.
+    RecordWriter topWriter(octree, chunkDepth, false);
+    topWriter.Write(0, 0, glm::ivec3(0));
+    std::vector<std::pair<glm::ivec3, int>> roots = std::move(topWriter.ChunkRoots());
+    std::sort(roots.begin(), roots.end(), [](const std::pair<glm::ivec3, int>& a, const std::pair<glm::ivec3, int>& b) {
+        return CoordLess(a.first, b.first);
+    });
+    Record top = Compress(topWriter);
+
+    std::unordered_map<int, size_t> recordOf;
+    std::vector<int> recordRoots;
+    for (const auto& root : roots) {
+        if (recordOf.emplace(root.second, recordRoots.size()).second)
+            recordRoots.push_back(root.second);
+    }
+    std::vector<Record> records(recordRoots.size());
+    ParallelFor(recordRoots.size(), threadCount, [&](size_t i) {
+        RecordWriter writer(octree, -1, octree.IsMerged());
+        writer.Write(recordRoots[i], chunkDepth, glm::ivec3(0));
+        records[i] = Compress(writer);
+    });
+
+    ChunkedWorldHeader header = {};
+    std::memcpy(header.magic, "SVOCHUNK", sizeof(header.magic));
+    header.version = ChunkedWorldHeader::Version;
+    header.headerSize = sizeof(ChunkedWorldHeader);
+    header.size = octree.Size();
+    header.maxDepth = octree.MaxDepth();
+    header.seed = seed;
+    header.flags = octree.IsMerged() ? ChunkedWorldHeader::MergedFlag : 0;
+    header.generator = generator;
+    header.chunkDepth = chunkDepth;
+    header.chunkCount = static_cast<uint32_t>(roots.size());
+    header.indexOffset = sizeof(ChunkedWorldHeader);
+    header.topOffset = header.indexOffset + roots.size() * sizeof(ChunkedWorldChunk);
+    header.topLength = static_cast<uint32_t>(top.data.size());
+    header.topRawLength = top.rawLength;
+    header.topNodeCount = top.nodeCount;
+    uint64_t offset = header.topOffset + top.data.size();
+    for (Record& record : records) {
+        record.offset = offset;
+        offset += record.data.size();
+    }
+
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "Could not write " << temporary << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& root : roots) {
+        const Record& record = records[recordOf[root.second]];
+        ChunkedWorldChunk chunk = {root.first.x, root.first.y, root.first.z, record.nodeCount,
+                                   record.offset, static_cast<uint32_t>(record.data.size()), record.rawLength};
+        out.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+    }
+    out.write(reinterpret_cast<const char*>(top.data.data()), static_cast<std::streamsize>(top.data.size()));
+    for (const Record& record : records)
+        out.write(reinterpret_cast<const char*>(record.data.data()), static_cast<std::streamsize>(record.data.size()));
+    out.close();
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cout << "Could not write " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ChunkedWorldFile::Open(const std::string& path) {
+    // Chunks may be read in any order.
+    if (!m_file.Open(path, false))
+        return false;
+
+    const char* problem = nullptr;
+    uint64_t length = m_file.Length();
+    if (length < sizeof(ChunkedWorldHeader) || std::memcmp(Header().magic, "SVOCHUNK", sizeof(Header().magic)) != 0) {
+        problem = "not a chunked world file";
+    } else {
+        const ChunkedWorldHeader& header = Header();
+        int grid = header.chunkDepth >= 1 && header.chunkDepth <= 30 ? 1 << header.chunkDepth : 0;
+        if (header.version != ChunkedWorldHeader::Version || header.headerSize != sizeof(ChunkedWorldHeader))
+            problem = "unsupported version";
+        else if (header.maxDepth < 1 || header.maxDepth > 63 || header.chunkDepth < 1 || header.chunkDepth > header.maxDepth ||
+                 header.topNodeCount == 0 || header.indexOffset % alignof(ChunkedWorldChunk) != 0 ||
+                 header.indexOffset + uint64_t(header.chunkCount) * sizeof(ChunkedWorldChunk) > length ||
+                 header.topOffset + header.topLength > length)
+            problem = "truncated or corrupt";
+        for (size_t i = 0; !problem && i < header.chunkCount; i++) {
+            const ChunkedWorldChunk& chunk = Chunk(i);
+            glm::ivec3 coord(chunk.x, chunk.y, chunk.z);
+            if (chunk.offset + chunk.length > length || chunk.nodeCount == 0 ||
+                glm::any(glm::lessThan(coord, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::ivec3(grid))) ||
+                (i > 0 && !CoordLess(glm::ivec3(Chunk(i - 1).x, Chunk(i - 1).y, Chunk(i - 1).z), coord)))
+                problem = "truncated or corrupt";
+        }
+    }
+    if (problem) {
+        std::cout << path << ": " << problem << std::endl;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool ChunkedWorldFile::Matches(int size, int maxDepth, uint32_t seed, uint32_t generator) const {
+    return IsOpen() && Header().size == size && Header().maxDepth == maxDepth && Header().seed == seed &&
+           Header().generator == generator;
+}
+
+int ChunkedWorldFile::FindChunk(glm::ivec3 coord) const {
+    const ChunkedWorldChunk* first = &Chunk(0);
+    const ChunkedWorldChunk* last = first + ChunkCount();
+    const ChunkedWorldChunk* found = std::lower_bound(first, last, coord, [](const ChunkedWorldChunk& chunk, glm::ivec3 key) {
+        return CoordLess(glm::ivec3(chunk.x, chunk.y, chunk.z), key);
+    });
+    if (found == last || found->x != coord.x || found->y != coord.y || found->z != coord.z)
+        return -1;
+    return static_cast<int>(found - first);
+}
+
+bool ChunkedWorldFile::ReadChunk(size_t index, std::vector<FlattenedNode>& nodes, std::vector<uint32_t>& colors) const {
+    const ChunkedWorldChunk& chunk = Chunk(index);
+    return ReadRecord(chunk.offset, chunk.length, chunk.rawLength, chunk.nodeCount, Header().chunkDepth,
+                      nodes, colors, nullptr, nullptr);
+}
+
+bool ChunkedWorldFile::ReadRecord(uint64_t offset, uint32_t length, uint32_t rawLength, uint32_t nodeCount, int depth,
+                                  std::vector<FlattenedNode>& nodes, std::vector<uint32_t>& colors,
+                                  std::vector<int>* chunkSlots, std::vector<glm::ivec3>* chunkCoords) const {
+    nodes.clear();
+    colors.clear();
+    if (rawLength < uint64_t(nodeCount) * 6)
+        return false; // At least the flags, mask and color of each node
+    std::vector<uint8_t> raw(rawLength);
+    const uint8_t* compressed = reinterpret_cast<const uint8_t*>(m_file.Data() + offset);
+    if (!LzDecompress(compressed, length, raw.data(), raw.size()))
+        return false;
+
+    const uint8_t* data = raw.data();
+    const uint8_t* end = raw.data() + rawLength - size_t(nodeCount) * 4; // Colors start here
+    bool shared = !chunkSlots && (Header().flags & ChunkedWorldHeader::MergedFlag);
+    int chunkDepth = Header().chunkDepth;
+    int maxDepth = Header().maxDepth;
+    nodes.reserve(nodeCount);
+    // Mirrors RecordWriter::Write; returns the node's index or -1.
+    auto read = [&](auto& self, int nodeDepth, glm::ivec3 coord) -> int {
+        if (nodes.size() == nodeCount || end - data < 2 || data[0] > 1)
+            return -1;
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        nodes[index].IsLeaf = data[0] != 0;
+        uint8_t mask = data[1];
+        data += 2;
+        for (int octant = 0; octant < 8; octant++) {
+            if (!(mask & (1 << octant)))
+                continue;
+            if (nodeDepth + 1 > maxDepth)
+                return -1;
+            if (chunkSlots && nodeDepth + 1 == chunkDepth) {
+                chunkSlots->push_back(index * 8 + octant);
+                chunkCoords->push_back(ChildCoord(coord, octant));
+                continue;
+            }
+            uint32_t back = 0;
+            if (shared && !ReadVarint(data, end, &back))
+                return -1;
+            int child;
+            if (back == 0) {
+                child = self(self, nodeDepth + 1, ChildCoord(coord, octant));
+                if (child == -1)
+                    return -1;
+            } else {
+                if (back > nodes.size())
+                    return -1;
+                child = static_cast<int>(nodes.size() - back);
+            }
+            nodes[index].childIndices[octant] = child;
+        }
+        return index;
+    };
+    if (read(read, depth, glm::ivec3(0)) != 0 || nodes.size() != nodeCount || data != end)
+        return false;
+
+    colors.resize(nodeCount);
+    uint32_t previous = 0;
+    for (uint32_t& color : colors) {
+        color = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+            color |= static_cast<uint32_t>(static_cast<uint8_t>((previous >> shift) + *data++)) << shift;
+        previous = color;
+    }
+    return true;
+}
+
+bool SparseVoxelOctree::Load(const ChunkedWorldFile& file, int threadCount) {
+    if (!file.IsOpen())
+        return false;
+    const ChunkedWorldHeader& header = file.Header();
+    if (header.size != m_size || header.maxDepth != m_maxDepth) {
+        std::cout << "Chunked world has size " << header.size << " and depth " << header.maxDepth
+                  << ", expected " << m_size << " and " << m_maxDepth << std::endl;
+        return false;
+    }
+
+    std::vector<FlattenedNode> topNodes;
+    std::vector<uint32_t> topColors;
+    std::vector<int> slots;
+    std::vector<glm::ivec3> coords;
+    bool ok = file.ReadRecord(header.topOffset, header.topLength, header.topRawLength, header.topNodeCount, 0,
+                              topNodes, topColors, &slots, &coords);
+
+    // Chunks sharing a record are decoded once and linked from every slot.
+    std::unordered_map<uint64_t, size_t> recordOf;
+    std::vector<size_t> recordChunks;
+    std::vector<size_t> slotRecords;
+    for (size_t i = 0; ok && i < coords.size(); i++) {
+        int chunk = file.FindChunk(coords[i]);
+        if (chunk == -1) {
+            ok = false;
+            break;
+        }
+        auto inserted = recordOf.emplace(file.Chunk(chunk).offset, recordChunks.size());
+        if (inserted.second)
+            recordChunks.push_back(static_cast<size_t>(chunk));
+        slotRecords.push_back(inserted.first->second);
+    }
+
+    std::vector<std::vector<FlattenedNode>> nodes(recordChunks.size());
+    std::vector<std::vector<uint32_t>> colors(recordChunks.size());
+    std::atomic<bool> corrupt(false);
+    if (ok) {
+        ParallelFor(recordChunks.size(), threadCount, [&](size_t i) {
+            if (!file.ReadChunk(recordChunks[i], nodes[i], colors[i]))
+                corrupt = true;
+        });
+    }
+    std::vector<size_t> bases(recordChunks.size());
+    size_t total = topNodes.size();
+    for (size_t i = 0; i < recordChunks.size(); i++) {
+        bases[i] = total;
+        total += nodes[i].size();
+    }
+    if (!ok || corrupt || total > size_t(1) << 31) {
+        std::cout << "Chunked world is corrupt" << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < slots.size(); i++)
+        topNodes[slots[i] / 8].childIndices[slots[i] % 8] = static_cast<int>(bases[slotRecords[i]]);
+    m_nodes.assign(topNodes.data(), topNodes.size());
+    m_colors.assign(topColors.data(), topColors.size());
+    m_nodes.resize(total);
+    m_colors.resize(total);
+    // Records land in disjoint ranges of blocks that already exist.
+    ParallelFor(recordChunks.size(), threadCount, [&](size_t i) {
+        int base = static_cast<int>(bases[i]);
+        for (size_t j = 0; j < nodes[i].size(); j++) {
+            FlattenedNode node = nodes[i][j];
+            for (int& child : node.childIndices) {
+                if (child != -1)
+                    child += base;
+            }
+            m_nodes[base + j] = node;
+            m_colors[base + j] = colors[i][j];
+        }
+    });
+    m_merged = (header.flags & ChunkedWorldHeader::MergedFlag) != 0;
+    m_freeNodes.clear();
+    MarkAllDirty();
+    return true;
+}
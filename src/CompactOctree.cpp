@@ -0,0 +1,61 @@
+#include "CompactOctree.h"
+
+CompactOctree::CompactOctree(const SparseVoxelOctree& octree)
+    : m_maxDepth(octree.MaxDepth()), m_halfSizes(octree.HalfSizes()), m_rootIsLeaf(octree.Nodes()[0].IsLeaf) {
+    const NodeArena<FlattenedNode>& sourceNodes = octree.Nodes();
+    const NodeArena<uint32_t>& sourceColors = octree.Colors();
+    // Breadth first: when a node is reached its children are appended as one
+    // block, which is exactly the layout childBase needs.
+    std::vector<int> sources;
+    sources.reserve(sourceNodes.size());
+    sources.push_back(0);
+    m_nodes.reserve(sourceNodes.size());
+    m_nodes.push_back(CompactNode());
+    // A merged tree expands into more nodes than its arena holds, so the
+    // colors grow with the nodes.
+    m_colors.reserve(sourceNodes.size());
+    m_colors.push_back(sourceColors[0]);
+    for (size_t i = 0; i < sources.size(); i++) {
+        const FlattenedNode& source = sourceNodes[sources[i]];
+        CompactNode node;
+        node.childBase = static_cast<uint32_t>(m_nodes.size());
+        for (int octant = 0; octant < 8; octant++) {
+            int child = source.childIndices[octant];
+            if (child == -1)
+                continue;
+            node.validMask |= 1u << octant;
+            if (sourceNodes[child].IsLeaf)
+                node.leafMask |= 1u << octant;
+            sources.push_back(child);
+            m_nodes.push_back(CompactNode());
+            m_colors.push_back(sourceColors[child]);
+        }
+        m_nodes[i] = node;
+    }
+    if (m_rootIsLeaf)
+        m_nodes[0].flags |= CompactNode::RootLeafFlag;
+}
+
+bool CompactOctree::Lookup(glm::ivec3 point, glm::vec4* color) const {
+    int nodeIndex = 0;
+    glm::ivec3 position(0);
+    // Below the root the parent's leaf mask says where to stop, without
+    // touching the child's record first.
+    bool isLeaf = m_rootIsLeaf;
+    for (int depth = 0; depth <= m_maxDepth; depth++) {
+        const CompactNode& node = m_nodes[nodeIndex];
+        if (isLeaf) {
+            if (color)
+                *color = UnpackColor(m_colors[nodeIndex]);
+            return true;
+        }
+        if (depth == m_maxDepth)
+            break;
+        int octant = SparseVoxelOctree::ChildOctant(point, position, m_halfSizes[depth]);
+        if (!(node.validMask & (1u << octant)))
+            break;
+        isLeaf = (node.leafMask & (1u << octant)) != 0;
+        nodeIndex = static_cast<int>(node.childBase) + PopCount(node.validMask & ((1u << octant) - 1));
+    }
+    return false;
+}
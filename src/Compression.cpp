@@ -0,0 +1,119 @@
+#include "Compression.h"
+#include <cstring>
+
+namespace {
+
+const int MinMatch = 4;
+const size_t MaxOffset = 65535;
+const int MaxHashBits = 16;
+// The last bytes are always literals, so matching can read four bytes at
+// any position it tries without checking the end.
+const size_t EndLiterals = 8;
+
+uint32_t Read32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t value, int bits) {
+    return (value * 2654435761u) >> (32 - bits);
+}
+
+// Lengths that don't fit in a token nibble continue in 255-valued bytes.
+void WriteLength(std::vector<uint8_t>& out, size_t length) {
+    for (; length >= 255; length -= 255)
+        out.push_back(255);
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+bool ReadLength(const uint8_t*& data, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (data == end)
+            return false;
+        byte = *data++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+    out.push_back(static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4 | (matchCode < 15 ? matchCode : 15)));
+    if (literalCount >= 15)
+        WriteLength(out, literalCount - 15);
+    out.insert(out.end(), literals, literals + literalCount);
+    if (!matchLength)
+        return; // The last sequence has no match
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (matchCode >= 15)
+        WriteLength(out, matchCode - 15);
+}
+
+} // namespace
+
+void LzCompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    // Small inputs get a small table, so compressing many short records
+    // doesn't spend its time clearing one.
+    int bits = 8;
+    while (bits < MaxHashBits && (size_t(1) << bits) < size)
+        bits++;
+    std::vector<uint32_t> table(size_t(1) << bits, 0); // Position + 1 of the last occurrence
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t limit = size > EndLiterals ? size - EndLiterals : 0;
+    while (position < limit) {
+        uint32_t value = Read32(data + position);
+        uint32_t& slot = table[Hash(value, bits)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position + 1);
+        if (candidate == 0 || position - (candidate - 1) > MaxOffset || Read32(data + candidate - 1) != value) {
+            position++;
+            continue;
+        }
+        candidate--;
+        size_t length = MinMatch;
+        while (position + length < limit && data[candidate + length] == data[position + length])
+            length++;
+        WriteSequence(out, data + anchor, position - anchor, position - candidate, length);
+        position += length;
+        anchor = position;
+    }
+    WriteSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+bool LzDecompress(const uint8_t* data, size_t length, uint8_t* out, size_t size) {
+    const uint8_t* end = data + length;
+    size_t written = 0;
+    while (data < end) {
+        uint8_t token = *data++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(data, end, &literalCount))
+            return false;
+        if (literalCount > static_cast<size_t>(end - data) || literalCount > size - written)
+            return false;
+        std::memcpy(out + written, data, literalCount);
+        data += literalCount;
+        written += literalCount;
+        if (data == end)
+            break; // The last sequence has no match
+        if (end - data < 2)
+            return false;
+        size_t offset = data[0] | size_t(data[1]) << 8;
+        data += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(data, end, &matchLength))
+            return false;
+        matchLength += MinMatch;
+        if (offset == 0 || offset > written || matchLength > size - written)
+            return false;
+        // Byte by byte: a match may overlap the bytes it produces.
+        const uint8_t* source = out + written - offset;
+        for (size_t i = 0; i < matchLength; i++)
+            out[written + i] = source[i];
+        written += matchLength;
+    }
+    return written == size;
+}
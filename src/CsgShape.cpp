@@ -0,0 +1,65 @@
+#include "CsgShape.h"
+#include <algorithm>
+
+CsgShape CsgShape::Sphere(glm::vec3 center, float radius) {
+    return CsgShape(Kind::Sphere, center, center, radius);
+}
+
+CsgShape CsgShape::Box(glm::vec3 min, glm::vec3 max) {
+    return CsgShape(Kind::Box, glm::min(min, max), glm::max(min, max), 0.0f);
+}
+
+CsgShape CsgShape::Capsule(glm::vec3 a, glm::vec3 b, float radius) {
+    return CsgShape(Kind::Capsule, a, b, radius);
+}
+
+float CsgShape::SegmentDistance(glm::vec3 point) const {
+    glm::vec3 segment = m_b - m_a;
+    float lengthSquared = glm::dot(segment, segment);
+    float t = lengthSquared > 0.0f ? glm::clamp(glm::dot(point - m_a, segment) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+    return glm::length(point - (m_a + segment * t));
+}
+
+bool CsgShape::Contains(glm::vec3 point) const {
+    switch (m_kind) {
+    case Kind::Sphere:
+        return glm::dot(point - m_a, point - m_a) <= m_radius * m_radius;
+    case Kind::Box:
+        return glm::all(glm::greaterThanEqual(point, m_a)) && glm::all(glm::lessThanEqual(point, m_b));
+    case Kind::Capsule:
+        return SegmentDistance(point) <= m_radius;
+    }
+    return false;
+}
+
+CsgShape::Coverage CsgShape::Classify(glm::vec3 lo, glm::vec3 hi) const {
+    switch (m_kind) {
+    case Kind::Sphere: {
+        glm::vec3 nearest = glm::clamp(m_a, lo, hi) - m_a;
+        if (glm::dot(nearest, nearest) > m_radius * m_radius)
+            return Coverage::None;
+        glm::vec3 farthest = glm::max(glm::abs(lo - m_a), glm::abs(hi - m_a));
+        return glm::dot(farthest, farthest) <= m_radius * m_radius ? Coverage::Full : Coverage::Partial;
+    }
+    case Kind::Box:
+        if (glm::any(glm::lessThan(hi, m_a)) || glm::any(glm::greaterThan(lo, m_b)))
+            return Coverage::None;
+        if (glm::all(glm::greaterThanEqual(lo, m_a)) && glm::all(glm::lessThanEqual(hi, m_b)))
+            return Coverage::Full;
+        return Coverage::Partial;
+    case Kind::Capsule: {
+        // The capsule is convex, so it holds the box if it holds the corners.
+        // Missing the box is judged from the box's bounding sphere.
+        glm::vec3 center = (lo + hi) * 0.5f;
+        if (SegmentDistance(center) > m_radius + glm::length(hi - center))
+            return Coverage::None;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 4) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y, (corner & 1) ? hi.z : lo.z);
+            if (SegmentDistance(point) > m_radius)
+                return Coverage::Partial;
+        }
+        return Coverage::Full;
+    }
+    }
+    return Coverage::Partial;
+}
@@ -0,0 +1,138 @@
+#include "DensityField.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <limits>
+
+DensityField::DensityField(const TerrainGenerator& terrain, const Heightfield& surface, const NoiseStack& caves, int layers)
+    : m_terrain(terrain), m_surface(surface), m_caves(caves), m_layers(layers) {
+    // A little slack, since the octaves are summed with rounding.
+    float slack = (caves.Max() - caves.Min()) * 1e-4f + 1e-4f;
+    m_noiseMin = caves.Min() - slack;
+    m_noiseMax = caves.Max() + slack;
+}
+
+float DensityField::Density(int ix, int iy, int iz) const {
+    float spacing = m_surface.Spacing();
+    float y = iy * spacing;
+    return m_surface.Height(ix, iz) - y + m_terrain.getNoise(m_caves, ix * spacing, y, iz * spacing);
+}
+
+bool DensityField::Solid(int ix, int iy, int iz) const {
+    int samples = m_surface.Samples();
+    if (iy >= m_layers)
+        return false;
+    if (iy <= 0 || ix < 0 || iz < 0 || ix >= samples || iz >= samples)
+        return true;
+    return Density(ix, iy, iz) > 0.0f;
+}
+
+bool DensityField::SolidBounded(int ix, int iy, int iz, size_t& samples) const {
+    int columns = m_surface.Samples();
+    if (iy >= m_layers)
+        return false;
+    if (iy <= 0 || ix < 0 || iz < 0 || ix >= columns || iz >= columns)
+        return true;
+    // Rounding is monotonic, so these agree with Density whenever the
+    // noise stays within its limits.
+    float base = m_surface.Height(ix, iz) - iy * m_surface.Spacing();
+    if (base + m_noiseMin > 0.0f)
+        return true;
+    if (base + m_noiseMax <= 0.0f)
+        return false;
+    samples++;
+    return Density(ix, iy, iz) > 0.0f;
+}
+
+DensityStats DensityField::Generate(std::vector<Voxel>& voxels, int threadCount, int chunkSize) const {
+    int samples = m_surface.Samples();
+    float spacing = m_surface.Spacing();
+    chunkSize = std::max(chunkSize, 1);
+    int chunksPerAxis = (samples + chunkSize - 1) / chunkSize;
+    int chunkLayers = (m_layers + chunkSize - 1) / chunkSize;
+    size_t columns = static_cast<size_t>(chunksPerAxis) * chunksPerAxis;
+
+    // Each worker takes a column of chunks, which share their height range.
+    std::vector<std::vector<Voxel>> found(columns);
+    std::vector<DensityStats> stats(columns);
+    ParallelFor(columns, threadCount, [&](size_t column) {
+        int x0 = static_cast<int>(column / chunksPerAxis) * chunkSize;
+        int z0 = static_cast<int>(column % chunksPerAxis) * chunkSize;
+        int x1 = std::min(x0 + chunkSize, samples);
+        int z1 = std::min(z0 + chunkSize, samples);
+        // The highest column in the chunks, and the lowest one counting the
+        // border; columns outside the grid are solid and don't lower it.
+        float innerMax = -std::numeric_limits<float>::infinity();
+        float borderMin = std::numeric_limits<float>::infinity();
+        for (int ix = std::max(x0 - 1, 0); ix < std::min(x1 + 1, samples); ix++) {
+            for (int iz = std::max(z0 - 1, 0); iz < std::min(z1 + 1, samples); iz++) {
+                float height = m_surface.Height(ix, iz);
+                borderMin = std::min(borderMin, height);
+                if (ix >= x0 && ix < x1 && iz >= z0 && iz < z1)
+                    innerMax = std::max(innerMax, height);
+            }
+        }
+
+        DensityStats& counts = stats[column];
+        std::vector<Voxel>& out = found[column];
+        std::vector<uint8_t> solid;
+        for (int cy = 0; cy < chunkLayers; cy++) {
+            int y0 = cy * chunkSize;
+            int y1 = std::min(y0 + chunkSize, m_layers);
+            // No voxel can be solid, not even the lowest under the highest
+            // column. The bottom chunk holds the bedrock.
+            if (y0 > 0 && innerMax - y0 * spacing + m_noiseMax <= 0.0f) {
+                counts.airChunks++;
+                continue;
+            }
+            // Every voxel up to the layer above the chunk is solid, so none
+            // of the chunk's voxels touch air.
+            if (y1 < m_layers && borderMin - y1 * spacing + m_noiseMin > 0.0f) {
+                counts.solidChunks++;
+                continue;
+            }
+            counts.mixedChunks++;
+
+            // Solid flags for the chunk and its one voxel border.
+            int wx = x1 - x0 + 2, wy = y1 - y0 + 2, wz = z1 - z0 + 2;
+            solid.resize(static_cast<size_t>(wx) * wy * wz);
+            auto at = [&](int dx, int dy, int dz) { return (static_cast<size_t>(dx) * wy + dy) * wz + dz; };
+            for (int dx = 0; dx < wx; dx++) {
+                for (int dy = 0; dy < wy; dy++) {
+                    for (int dz = 0; dz < wz; dz++)
+                        solid[at(dx, dy, dz)] = SolidBounded(x0 - 1 + dx, y0 - 1 + dy, z0 - 1 + dz, counts.noiseSamples);
+                }
+            }
+            for (int dx = 1; dx < wx - 1; dx++) {
+                for (int dy = 1; dy < wy - 1; dy++) {
+                    for (int dz = 1; dz < wz - 1; dz++) {
+                        if (!solid[at(dx, dy, dz)])
+                            continue;
+                        bool exposed = !solid[at(dx - 1, dy, dz)] || !solid[at(dx + 1, dy, dz)] ||
+                                       !solid[at(dx, dy - 1, dz)] || !solid[at(dx, dy + 1, dz)] ||
+                                       !solid[at(dx, dy, dz - 1)] || !solid[at(dx, dy, dz + 1)];
+                        if (!exposed)
+                            continue;
+                        int ix = x0 - 1 + dx, iy = y0 - 1 + dy, iz = z0 - 1 + dz;
+                        out.push_back({ glm::vec3(ix * spacing, iy * spacing, iz * spacing),
+                                        UnpackColor(m_surface.Color(ix, iz)) });
+                    }
+                }
+            }
+        }
+        counts.voxels = out.size();
+    });
+
+    DensityStats total;
+    size_t count = voxels.size();
+    for (size_t column = 0; column < columns; column++) {
+        total.airChunks += stats[column].airChunks;
+        total.solidChunks += stats[column].solidChunks;
+        total.mixedChunks += stats[column].mixedChunks;
+        total.noiseSamples += stats[column].noiseSamples;
+        total.voxels += stats[column].voxels;
+    }
+    voxels.reserve(count + total.voxels);
+    for (std::vector<Voxel>& column : found)
+        voxels.insert(voxels.end(), column.begin(), column.end());
+    return total;
+}
@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+#include <iostream>
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path, bool sequential) {
+    Close();
+#ifdef _WIN32
+    (void)sequential;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+    m_buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (m_buffer.empty()) {
+        std::cout << "Could not map " << path << std::endl;
+        return false;
+    }
+    m_data = m_buffer.data();
+    m_length = m_buffer.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cout << "Could not map " << path << std::endl;
+        return false;
+    }
+    // Advice values aren't flags, so each hint is its own call.
+    if (sequential) {
+        madvise(mapping, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        madvise(mapping, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+    } else {
+        madvise(mapping, static_cast<size_t>(info.st_size), MADV_RANDOM);
+    }
+    m_data = static_cast<const char*>(mapping);
+    m_length = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    m_buffer = std::string();
+#else
+    if (m_data)
+        munmap(const_cast<char*>(m_data), m_length);
+#endif
+    m_data = nullptr;
+    m_length = 0;
+}
@@ -0,0 +1,559 @@
+#include "Octree.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Stable LSD radix sort on the low `bits` bits of the key. Digits are at most
+// 11 bits wide so the counting table stays in L1.
+void RadixSort(SparseVoxelOctree::KeyedVoxel* items, size_t count, int bits) {
+    int passes = (bits + 10) / 11;
+    if (passes == 0 || count < 2)
+        return;
+    int digitBits = (bits + passes - 1) / passes;
+    uint64_t mask = (uint64_t(1) << digitBits) - 1;
+    std::vector<size_t> offsets;
+    std::vector<SparseVoxelOctree::KeyedVoxel> scratch(count);
+    SparseVoxelOctree::KeyedVoxel* from = items;
+    SparseVoxelOctree::KeyedVoxel* to = scratch.data();
+    for (int shift = 0; shift < bits; shift += digitBits) {
+        offsets.assign(mask + 2, 0);
+        for (size_t i = 0; i < count; i++)
+            offsets[((from[i].key >> shift) & mask) + 1]++;
+        for (uint64_t i = 0; i <= mask; i++)
+            offsets[i + 1] += offsets[i];
+        for (size_t i = 0; i < count; i++)
+            to[offsets[(from[i].key >> shift) & mask]++] = from[i];
+        std::swap(from, to);
+    }
+    if (from != items)
+        std::copy(from, from + count, items);
+}
+
+// Index of the highest set bit; value must be non-zero.
+int HighestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+} // namespace
+
+SparseVoxelOctree::SparseVoxelOctree(int size, int maxDepth)
+    : m_size(size), m_maxDepth(maxDepth) {
+    for (int depth = 0; depth <= maxDepth; depth++) {
+        float nodeSize = m_size / std::exp2(depth);
+        m_halfSizes.push_back(static_cast<int>(nodeSize / 2.0f));
+    }
+    m_nodes.push_back(FlattenedNode()); // root node
+    m_colors.push_back(PackColor(glm::vec4(1.0f)));
+}
+
+void SparseVoxelOctree::Insert(glm::vec3 point, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot insert into an octree with merged subtrees" << std::endl;
+        return;
+    }
+    InsertImpl(0, glm::ivec3(point), PackColor(color), glm::ivec3(0), 0);
+}
+
+void SparseVoxelOctree::InsertImpl(int nodeIndex, glm::ivec3 point, uint32_t color, glm::ivec3 position, int depth) {
+    if (nodeIndex >= m_nodes.size()) {
+        std::cout << "Index out of bounds" << std::endl;
+        return;
+    }
+    if (m_nodes[nodeIndex].IsLeaf && depth < m_maxDepth) {
+        // A collapsed leaf already covers the point; only a different color
+        // makes it worth splitting back into children.
+        if (m_colors[nodeIndex] == color)
+            return;
+        SplitLeaf(nodeIndex);
+    }
+    MarkDirty(nodeIndex);
+    if (depth == m_maxDepth) {
+        m_nodes[nodeIndex].IsLeaf = true;
+        m_colors[nodeIndex] = color;
+        return;
+    }
+    int half = m_halfSizes[depth];
+    glm::ivec3 center = position + glm::ivec3(half);
+    glm::ivec3 childPos = {
+        (point.x >= center.x) ? 1 : 0,
+        (point.y >= center.y) ? 1 : 0,
+        (point.z >= center.z) ? 1 : 0
+    };
+    int childIndex = (childPos.x << 2) | (childPos.y << 1) | (childPos.z);
+    // Allocating may grow m_nodes, so the node is looked up again afterwards.
+    if (m_nodes[nodeIndex].childIndices[childIndex] == -1) {
+        int child = AllocateNode();
+        m_nodes[nodeIndex].childIndices[childIndex] = child;
+    }
+    glm::ivec3 newPosition = position + childPos * glm::ivec3(half);
+    InsertImpl(m_nodes[nodeIndex].childIndices[childIndex], point, color, newPosition, depth + 1);
+    if (m_collapseOnInsert)
+        TryCollapse(nodeIndex, true);
+    RefilterPath(&nodeIndex, 1);
+}
+
+void SparseVoxelOctree::InsertBatch(const Voxel* voxels, size_t count) {
+    if (m_merged) {
+        std::cout << "Cannot insert into an octree with merged subtrees" << std::endl;
+        return;
+    }
+    if (count == 0)
+        return;
+    if (m_maxDepth >= 64) {
+        std::cout << "Batched inserts support at most 63 levels" << std::endl;
+        return;
+    }
+    InsertPath path(m_size);
+    for (size_t i = 0; i < count; i++) {
+        // Points outside the cube land in its border cells, as with Insert.
+        glm::ivec3 point = glm::clamp(glm::ivec3(voxels[i].position), glm::ivec3(0), glm::ivec3(m_size - 1));
+        InsertAlongPath(path, point, PackColor(voxels[i].color));
+    }
+    ClosePath(path, -1);
+}
+
+void SparseVoxelOctree::InsertColumn(int x, int z, int yMin, int yMax, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot insert into an octree with merged subtrees" << std::endl;
+        return;
+    }
+    if (yMin > yMax)
+        return;
+    if (m_maxDepth >= 64) {
+        std::cout << "Batched inserts support at most 63 levels" << std::endl;
+        return;
+    }
+    glm::ivec3 point = glm::clamp(glm::ivec3(x, yMin, z), glm::ivec3(0), glm::ivec3(m_size - 1));
+    yMax = std::min(std::max(yMax, 0), m_size - 1);
+    uint32_t packed = PackColor(color);
+    InsertPath path(m_size);
+    // Every point of a leaf's cell ends in that leaf, so the walk jumps
+    // straight to the first y above the cell it just filled.
+    while (point.y <= yMax) {
+        InsertAlongPath(path, point, packed);
+        point.y = path.hi[path.depth].y;
+    }
+    ClosePath(path, -1);
+}
+
+SparseVoxelOctree::InsertPath::InsertPath(int size) {
+    nodes[0] = 0;
+    lo[0] = glm::ivec3(0);
+    hi[0] = glm::ivec3(size);
+}
+
+void SparseVoxelOctree::InsertAlongPath(InsertPath& path, glm::ivec3 point, uint32_t color) {
+    // Back up to the deepest node on the path whose cell holds the point.
+    int depth = path.depth;
+    while (depth > 0 && !(glm::all(glm::greaterThanEqual(point, path.lo[depth])) &&
+                          glm::all(glm::lessThan(point, path.hi[depth]))))
+        depth--;
+    ClosePath(path, depth);
+    for (;; depth++) {
+        int nodeIndex = path.nodes[depth];
+        if (m_nodes[nodeIndex].IsLeaf && depth < m_maxDepth) {
+            if (m_colors[nodeIndex] == color)
+                break;
+            SplitLeaf(nodeIndex);
+        }
+        if (depth == m_maxDepth) {
+            m_nodes[nodeIndex].IsLeaf = true;
+            break;
+        }
+        int half = m_halfSizes[depth];
+        glm::ivec3 position = path.lo[depth];
+        int octant = ChildOctant(point, position, half);
+        if (m_nodes[nodeIndex].childIndices[octant] == -1) {
+            int child = AllocateNode();
+            m_nodes[nodeIndex].childIndices[octant] = child;
+        }
+        glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+        path.nodes[depth + 1] = m_nodes[nodeIndex].childIndices[octant];
+        path.lo[depth + 1] = position;
+        path.hi[depth + 1] = glm::mix(path.lo[depth] + glm::ivec3(half), path.hi[depth], glm::equal(offset, glm::ivec3(1)));
+    }
+    path.depth = depth;
+    path.color = color;
+}
+
+void SparseVoxelOctree::ClosePath(InsertPath& path, int depth) {
+    for (; path.depth > depth; path.depth--) {
+        int nodeIndex = path.nodes[path.depth];
+        // Leaves take the voxel's color; interior nodes are refiltered once
+        // their children are settled.
+        if (m_nodes[nodeIndex].IsLeaf)
+            m_colors[nodeIndex] = path.color;
+        MarkDirty(nodeIndex);
+        if (m_collapseOnInsert)
+            TryCollapse(nodeIndex, true);
+        RefilterPath(&nodeIndex, 1);
+    }
+}
+
+int SparseVoxelOctree::AllocateNode() {
+    int index;
+    if (!m_freeNodes.empty()) {
+        index = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        m_nodes[index] = FlattenedNode();
+        m_colors[index] = PackColor(glm::vec4(1.0f));
+    } else {
+        index = static_cast<int>(m_nodes.size());
+        m_nodes.push_back(FlattenedNode());
+        m_colors.push_back(PackColor(glm::vec4(1.0f)));
+    }
+    MarkDirty(index);
+    return index;
+}
+
+void SparseVoxelOctree::FreeSubtree(int nodeIndex) {
+    std::vector<int> stack(1, nodeIndex);
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        for (int child : m_nodes[index].childIndices) {
+            if (child != -1)
+                stack.push_back(child);
+        }
+        m_nodes[index] = FlattenedNode();
+        m_freeNodes.push_back(index);
+    }
+}
+
+void SparseVoxelOctree::SplitLeaf(int nodeIndex) {
+    uint32_t color = m_colors[nodeIndex];
+    m_nodes[nodeIndex].IsLeaf = false;
+    MarkDirty(nodeIndex);
+    for (int octant = 0; octant < 8; octant++) {
+        int child = AllocateNode();
+        m_nodes[child].IsLeaf = true;
+        m_colors[child] = color;
+        m_nodes[nodeIndex].childIndices[octant] = child;
+    }
+}
+
+bool SparseVoxelOctree::TryCollapse(int nodeIndex, bool recycle) {
+    FlattenedNode& node = m_nodes[nodeIndex];
+    if (node.IsLeaf)
+        return false;
+    uint32_t color = 0;
+    for (int octant = 0; octant < 8; octant++) {
+        int child = node.childIndices[octant];
+        if (child == -1 || !m_nodes[child].IsLeaf)
+            return false;
+        if (octant == 0)
+            color = m_colors[child];
+        else if (m_colors[child] != color)
+            return false;
+    }
+    for (int& child : node.childIndices) {
+        if (recycle)
+            FreeSubtree(child);
+        child = -1;
+    }
+    node.IsLeaf = true;
+    m_colors[nodeIndex] = color;
+    MarkDirty(nodeIndex);
+    return true;
+}
+
+bool SparseVoxelOctree::Lookup(glm::ivec3 point, glm::vec4* color) const {
+    int nodeIndex = 0;
+    glm::ivec3 position(0);
+    for (int depth = 0; depth <= m_maxDepth; depth++) {
+        const FlattenedNode& node = m_nodes[nodeIndex];
+        if (node.IsLeaf) {
+            if (color)
+                *color = UnpackColor(m_colors[nodeIndex]);
+            return true;
+        }
+        if (depth == m_maxDepth)
+            break;
+        nodeIndex = node.childIndices[ChildOctant(point, position, m_halfSizes[depth])];
+        if (nodeIndex == -1)
+            break;
+    }
+    return false;
+}
+
+uint64_t SparseVoxelOctree::AxisKey(int coord) const {
+    // The three axes are split independently, so each one contributes every
+    // third bit of the key; this spreads one axis' decisions into those bits.
+    uint64_t key = 0;
+    int position = 0;
+    for (int depth = 0; depth < m_maxDepth; depth++) {
+        int bit = (coord >= position + m_halfSizes[depth]) ? 1 : 0;
+        key |= static_cast<uint64_t>(bit) << (3 * (m_maxDepth - 1 - depth));
+        position += bit * m_halfSizes[depth];
+    }
+    return key;
+}
+
+uint64_t SparseVoxelOctree::MortonKey(glm::ivec3 point) const {
+    return (AxisKey(point.x) << 2) | (AxisKey(point.y) << 1) | AxisKey(point.z);
+}
+
+int SparseVoxelOctree::SharedDepth(uint64_t a, uint64_t b) const {
+    if (a == b)
+        return m_maxDepth;
+    return m_maxDepth - 1 - HighestBit(a ^ b) / 3;
+}
+
+std::vector<uint64_t> SparseVoxelOctree::AxisKeyTable() const {
+    // Coordinates inside the cube go through a per-axis lookup table instead
+    // of walking all levels for every voxel.
+    std::vector<uint64_t> table;
+    if (m_size <= (1 << 20)) {
+        table.resize(m_size);
+        for (int coord = 0; coord < m_size; coord++)
+            table[coord] = AxisKey(coord);
+    }
+    return table;
+}
+
+uint64_t SparseVoxelOctree::KeyOf(const std::vector<uint64_t>& axisKeys, glm::vec3 position) const {
+    glm::ivec3 point(position);
+    auto axisKey = [&](int coord) {
+        return (coord >= 0 && coord < static_cast<int>(axisKeys.size())) ? axisKeys[coord] : AxisKey(coord);
+    };
+    return (axisKey(point.x) << 2) | (axisKey(point.y) << 1) | axisKey(point.z);
+}
+
+void SparseVoxelOctree::SortVoxels(const std::vector<Voxel>& voxels, std::vector<KeyedVoxel>& keyed) const {
+    std::vector<uint64_t> axisKeys = AxisKeyTable();
+    keyed.resize(voxels.size());
+    for (size_t i = 0; i < voxels.size(); i++)
+        keyed[i] = { KeyOf(axisKeys, voxels[i].position), static_cast<uint32_t>(i) };
+    RadixSort(keyed.data(), keyed.size(), 3 * m_maxDepth);
+}
+
+void SparseVoxelOctree::CountNodes(const KeyedVoxel* keyed, size_t count, int rootDepth, std::vector<int>& counts) const {
+    for (size_t i = 0; i < count; i++) {
+        // A voxel opens a new node at every depth below the deepest one it
+        // shares with the voxel before it.
+        int first = (i == 0) ? rootDepth + 1 : SharedDepth(keyed[i - 1].key, keyed[i].key) + 1;
+        for (int depth = first; depth <= m_maxDepth; depth++)
+            counts[depth]++;
+    }
+}
+
+uint32_t SparseVoxelOctree::EmitSubtree(const KeyedVoxel* keyed, size_t count, const std::vector<Voxel>& voxels,
+                                        int rootDepth, int rootIndex, std::vector<int>& cursors) {
+    // path[depth] is the open node at that depth and lastOrder[depth] the
+    // latest voxel seen below it. A node is closed, and gets its color, once
+    // the sorted keys leave its subtree, so colors settle from the leaves up.
+    int path[64];
+    uint32_t lastOrder[64];
+    path[rootDepth] = rootIndex;
+    lastOrder[rootDepth] = keyed[0].order;
+
+    auto close = [&](int depth) {
+        m_colors[path[depth]] = PackColor(voxels[lastOrder[depth]].color);
+        lastOrder[depth - 1] = std::max(lastOrder[depth - 1], lastOrder[depth]);
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        const KeyedVoxel& item = keyed[i];
+        int first = rootDepth + 1;
+        if (i > 0) {
+            int shared = SharedDepth(keyed[i - 1].key, item.key);
+            if (shared == m_maxDepth) {
+                // Same leaf again; the sort is stable, so this voxel came later.
+                lastOrder[m_maxDepth] = item.order;
+                continue;
+            }
+            for (int depth = m_maxDepth; depth > shared; depth--)
+                close(depth);
+            first = shared + 1;
+        }
+        for (int depth = first; depth <= m_maxDepth; depth++) {
+            int index = cursors[depth]++;
+            int childIndex = static_cast<int>((item.key >> (3 * (m_maxDepth - depth))) & 7);
+            m_nodes[path[depth - 1]].childIndices[childIndex] = index;
+            path[depth] = index;
+            lastOrder[depth] = item.order;
+        }
+        m_nodes[path[m_maxDepth]].IsLeaf = true;
+    }
+    for (int depth = m_maxDepth; depth > rootDepth; depth--)
+        close(depth);
+    m_colors[rootIndex] = PackColor(voxels[lastOrder[rootDepth]].color);
+    return lastOrder[rootDepth];
+}
+
+void SparseVoxelOctree::Build(const std::vector<Voxel>& voxels) {
+    if (m_maxDepth > 21) {
+        std::cout << "Build supports at most 21 levels (64-bit Morton keys)" << std::endl;
+        return;
+    }
+    m_merged = false;
+    m_freeNodes.clear();
+    MarkAllDirty();
+    m_nodes.clear();
+    m_colors.clear();
+    if (voxels.empty()) {
+        m_nodes.push_back(FlattenedNode());
+        m_colors.push_back(PackColor(glm::vec4(1.0f)));
+        return;
+    }
+
+    std::vector<KeyedVoxel> keyed;
+    SortVoxels(voxels, keyed);
+
+    // Nodes are laid out breadth first, so knowing how many nodes each depth
+    // holds fixes where every node goes before any of them is written.
+    std::vector<int> counts(m_maxDepth + 1, 0);
+    counts[0] = 1;
+    CountNodes(keyed.data(), keyed.size(), 0, counts);
+    std::vector<int> cursors(m_maxDepth + 1, 0);
+    for (int depth = 1; depth <= m_maxDepth; depth++)
+        cursors[depth] = cursors[depth - 1] + counts[depth - 1];
+
+    m_nodes.resize(cursors[m_maxDepth] + counts[m_maxDepth]);
+    m_colors.resize(m_nodes.size());
+    cursors[0] = 1;
+    EmitSubtree(keyed.data(), keyed.size(), voxels, 0, 0, cursors);
+}
+
+void SparseVoxelOctree::Build(const std::vector<Voxel>& voxels, int threadCount) {
+    if (threadCount <= 1 || m_maxDepth < 2 || m_maxDepth > 21 || voxels.empty()) {
+        Build(voxels);
+        return;
+    }
+
+    // Split the cube into 8^splitDepth sub-cubes, a few per worker so that
+    // terrain leaving whole octants empty still keeps every core busy.
+    int splitDepth = 1;
+    while (splitDepth < std::min(m_maxDepth - 1, 4) && (size_t(1) << (3 * splitDepth)) < size_t(4) * threadCount)
+        splitDepth++;
+    int bucketShift = 3 * (m_maxDepth - splitDepth);
+    size_t bucketCount = size_t(1) << (3 * splitDepth);
+
+    // Key every voxel and scatter it into its sub-cube. Chunks are scattered
+    // in input order, so each bucket keeps the input order of its voxels.
+    std::vector<uint64_t> axisKeys = AxisKeyTable();
+    size_t chunkCount = static_cast<size_t>(threadCount);
+    size_t chunkSize = (voxels.size() + chunkCount - 1) / chunkCount;
+    std::vector<KeyedVoxel> unsorted(voxels.size());
+    std::vector<std::vector<size_t>> histograms(chunkCount, std::vector<size_t>(bucketCount, 0));
+    ParallelFor(chunkCount, threadCount, [&](size_t chunk) {
+        size_t end = std::min(voxels.size(), (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++) {
+            unsorted[i] = { KeyOf(axisKeys, voxels[i].position), static_cast<uint32_t>(i) };
+            histograms[chunk][unsorted[i].key >> bucketShift]++;
+        }
+    });
+    std::vector<size_t> bucketStart(bucketCount + 1, 0);
+    size_t running = 0;
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+        bucketStart[bucket] = running;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+            size_t count = histograms[chunk][bucket];
+            histograms[chunk][bucket] = running;
+            running += count;
+        }
+    }
+    bucketStart[bucketCount] = running;
+    std::vector<KeyedVoxel> keyed(voxels.size());
+    ParallelFor(chunkCount, threadCount, [&](size_t chunk) {
+        size_t end = std::min(voxels.size(), (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+            keyed[histograms[chunk][unsorted[i].key >> bucketShift]++] = unsorted[i];
+    });
+    std::vector<KeyedVoxel>().swap(unsorted);
+
+    std::vector<size_t> buckets;
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+        if (bucketStart[bucket + 1] > bucketStart[bucket])
+            buckets.push_back(bucket);
+    }
+
+    // Sort each sub-cube and count its nodes per depth.
+    std::vector<std::vector<int>> counts(buckets.size(), std::vector<int>(m_maxDepth + 1, 0));
+    ParallelFor(buckets.size(), threadCount, [&](size_t i) {
+        size_t begin = bucketStart[buckets[i]];
+        size_t count = bucketStart[buckets[i] + 1] - begin;
+        RadixSort(keyed.data() + begin, count, bucketShift);
+        counts[i][splitDepth] = 1;
+        CountNodes(keyed.data() + begin, count, splitDepth, counts[i]);
+    });
+
+    // Lay out the breadth-first array exactly as the serial build does: the
+    // levels above the split hold one node per distinct prefix, and below it
+    // each depth is the sub-cubes' nodes of that depth in key order.
+    std::vector<int> depthCounts(m_maxDepth + 1, 0);
+    for (int depth = 0; depth < splitDepth; depth++) {
+        int shift = 3 * (splitDepth - depth);
+        for (size_t i = 0; i < buckets.size(); i++) {
+            if (i == 0 || (buckets[i] >> shift) != (buckets[i - 1] >> shift))
+                depthCounts[depth]++;
+        }
+    }
+    for (size_t i = 0; i < buckets.size(); i++) {
+        for (int depth = splitDepth; depth <= m_maxDepth; depth++)
+            depthCounts[depth] += counts[i][depth];
+    }
+    std::vector<int> depthOffsets(m_maxDepth + 2, 0);
+    for (int depth = 0; depth <= m_maxDepth; depth++)
+        depthOffsets[depth + 1] = depthOffsets[depth] + depthCounts[depth];
+
+    // Each sub-cube owns a contiguous range of every depth below the split and
+    // writes its nodes there directly, so no copy or fix-up pass is needed.
+    std::vector<std::vector<int>> cursors(buckets.size(), std::vector<int>(m_maxDepth + 1, 0));
+    std::vector<int> next(depthOffsets.begin(), depthOffsets.end() - 1);
+    for (size_t i = 0; i < buckets.size(); i++) {
+        for (int depth = splitDepth; depth <= m_maxDepth; depth++) {
+            cursors[i][depth] = next[depth];
+            next[depth] += counts[i][depth];
+        }
+    }
+
+    m_merged = false;
+    m_freeNodes.clear();
+    MarkAllDirty();
+    m_nodes.clear();
+    m_nodes.resize(depthOffsets[m_maxDepth + 1]);
+    m_colors.clear();
+    m_colors.resize(m_nodes.size());
+    std::vector<int> levelIndices(buckets.size());
+    std::vector<uint32_t> levelOrders(buckets.size());
+    ParallelFor(buckets.size(), threadCount, [&](size_t i) {
+        size_t begin = bucketStart[buckets[i]];
+        size_t count = bucketStart[buckets[i] + 1] - begin;
+        levelIndices[i] = cursors[i][splitDepth]++;
+        levelOrders[i] = EmitSubtree(keyed.data() + begin, count, voxels, splitDepth, levelIndices[i], cursors[i]);
+    });
+
+    // Link the sub-cube roots back up to the root, one level at a time.
+    std::vector<uint64_t> levelKeys(buckets.begin(), buckets.end());
+    for (int depth = splitDepth - 1; depth >= 0; depth--) {
+        std::vector<uint64_t> parentKeys;
+        std::vector<int> parentIndices;
+        std::vector<uint32_t> parentOrders;
+        for (size_t i = 0; i < levelKeys.size(); i++) {
+            uint64_t parentKey = levelKeys[i] >> 3;
+            if (parentKeys.empty() || parentKeys.back() != parentKey) {
+                parentKeys.push_back(parentKey);
+                parentIndices.push_back(depthOffsets[depth] + static_cast<int>(parentIndices.size()));
+                parentOrders.push_back(levelOrders[i]);
+            }
+            m_nodes[parentIndices.back()].childIndices[levelKeys[i] & 7] = levelIndices[i];
+            parentOrders.back() = std::max(parentOrders.back(), levelOrders[i]);
+        }
+        for (size_t i = 0; i < parentIndices.size(); i++)
+            m_colors[parentIndices[i]] = PackColor(voxels[parentOrders[i]].color);
+        levelKeys.swap(parentKeys);
+        levelIndices.swap(parentIndices);
+        levelOrders.swap(parentOrders);
+    }
+}
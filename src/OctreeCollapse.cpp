@@ -0,0 +1,94 @@
+#include "Octree.h"
+#include <algorithm>
+#include <iostream>
+
+void SparseVoxelOctree::InsertSolid(glm::ivec3 min, glm::ivec3 max, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot insert into an octree with merged subtrees" << std::endl;
+        return;
+    }
+    if (min.x > max.x || min.y > max.y || min.z > max.z)
+        return;
+    // Insert puts points outside the cube into its border cells; clamping
+    // the box to the cube does the same for a whole range.
+    min = glm::clamp(min, glm::ivec3(0), glm::ivec3(m_size - 1));
+    max = glm::clamp(max, glm::ivec3(0), glm::ivec3(m_size - 1));
+    InsertSolidImpl(0, min, max, PackColor(color), glm::ivec3(0), glm::ivec3(m_size), 0);
+}
+
+void SparseVoxelOctree::InsertSolidImpl(int nodeIndex, glm::ivec3 min, glm::ivec3 max, uint32_t color,
+                                        glm::ivec3 lo, glm::ivec3 hi, int depth) {
+    // The node's cell holds the integer points [lo, hi).
+    bool covered = glm::all(glm::lessThanEqual(min, lo)) && glm::all(glm::greaterThanEqual(max, hi - 1));
+    MarkDirty(nodeIndex);
+    if (m_nodes[nodeIndex].IsLeaf) {
+        if (m_colors[nodeIndex] == color || depth == m_maxDepth) {
+            m_colors[nodeIndex] = color;
+            return;
+        }
+        if (!covered)
+            SplitLeaf(nodeIndex);
+    }
+    if (covered || depth == m_maxDepth) {
+        for (int& child : m_nodes[nodeIndex].childIndices) {
+            if (child != -1)
+                FreeSubtree(child);
+            child = -1;
+        }
+        m_nodes[nodeIndex].IsLeaf = true;
+        m_colors[nodeIndex] = color;
+        return;
+    }
+
+    int half = m_halfSizes[depth];
+    for (int octant = 0; octant < 8; octant++) {
+        glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+        glm::ivec3 childLo = lo + offset * half;
+        glm::ivec3 childHi = glm::mix(lo + glm::ivec3(half), hi, glm::equal(offset, glm::ivec3(1)));
+        if (glm::any(glm::greaterThanEqual(childLo, childHi)))
+            continue;
+        if (glm::any(glm::greaterThan(childLo, max)) || glm::any(glm::lessThan(childHi - 1, min)))
+            continue;
+        if (m_nodes[nodeIndex].childIndices[octant] == -1) {
+            int child = AllocateNode();
+            m_nodes[nodeIndex].childIndices[octant] = child;
+        }
+        InsertSolidImpl(m_nodes[nodeIndex].childIndices[octant], min, max, color, childLo, childHi, depth + 1);
+    }
+    if (m_collapseOnInsert)
+        TryCollapse(nodeIndex, true);
+    RefilterPath(&nodeIndex, 1);
+}
+
+size_t SparseVoxelOctree::CollapseUniformSubtrees() {
+    // Post-order, so a node is tested after its children had their chance to
+    // collapse. Children are only unlinked here; Reorder drops them.
+    std::vector<bool> visited(m_nodes.size(), false);
+    struct Frame {
+        int node;
+        int nextChild;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({0, 0});
+    visited[0] = true;
+    // Free and already unreachable slots are dropped by Reorder too, so the
+    // count starts from the reachable nodes.
+    size_t reachable = 1;
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.nextChild < 8) {
+            int child = m_nodes[frame.node].childIndices[frame.nextChild++];
+            if (child != -1 && !visited[child]) {
+                visited[child] = true;
+                reachable++;
+                stack.push_back({child, 0});
+            }
+            continue;
+        }
+        TryCollapse(frame.node, false);
+        stack.pop_back();
+    }
+
+    Reorder(NodeLayout::BreadthFirst);
+    return reachable - m_nodes.size();
+}
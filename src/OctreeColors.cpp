@@ -0,0 +1,88 @@
+#include "Octree.h"
+#include "Parallel.h"
+#include <algorithm>
+
+void SparseVoxelOctree::FilterColors(ColorFilter filter, int threadCount) {
+    // Group nodes by height (longest path down to a leaf) rather than depth:
+    // a parent is always higher than its children, which stays true for
+    // leaves shared across depths in a merged tree.
+    std::vector<int> heights(m_nodes.size(), -1);
+    struct Frame {
+        int node;
+        int nextChild;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({0, 0});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        const FlattenedNode& node = m_nodes[frame.node];
+        if (frame.nextChild < 8) {
+            int child = node.childIndices[frame.nextChild++];
+            if (child != -1 && heights[child] == -1)
+                stack.push_back({child, 0});
+            continue;
+        }
+        int height = 0;
+        for (int child : node.childIndices) {
+            if (child != -1)
+                height = std::max(height, heights[child] + 1);
+        }
+        heights[frame.node] = height;
+        stack.pop_back();
+    }
+
+    std::vector<std::vector<int>> byHeight;
+    for (size_t i = 0; i < heights.size(); i++) {
+        if (heights[i] < 0)
+            continue;
+        if (heights[i] >= static_cast<int>(byHeight.size()))
+            byHeight.resize(heights[i] + 1);
+        byHeight[heights[i]].push_back(static_cast<int>(i));
+    }
+
+    // A child's coverage is read back from its alpha, which the pass below
+    // it has just written, so nodes of one height only read lower ones.
+    m_colorFilter = filter;
+    const size_t chunkSize = 4096;
+    for (size_t height = 1; height < byHeight.size(); height++) {
+        const std::vector<int>& level = byHeight[height];
+        ParallelFor((level.size() + chunkSize - 1) / chunkSize, threadCount, [&](size_t chunk) {
+            size_t end = std::min(level.size(), (chunk + 1) * chunkSize);
+            for (size_t i = chunk * chunkSize; i < end; i++) {
+                int nodeIndex = level[i];
+                if (!m_nodes[nodeIndex].IsLeaf)
+                    m_colors[nodeIndex] = FilteredColor(nodeIndex, filter);
+            }
+        });
+    }
+    MarkAllDirty();
+}
+
+uint32_t SparseVoxelOctree::FilteredColor(int nodeIndex, ColorFilter filter) const {
+    glm::vec3 sum(0.0f);
+    float weightSum = 0.0f;
+    float covered = 0.0f;
+    for (int child : m_nodes[nodeIndex].childIndices) {
+        if (child == -1)
+            continue;
+        glm::vec4 color = UnpackColor(m_colors[child]);
+        // Leaves are solid; their alpha is the voxel's own.
+        float coverage = m_nodes[child].IsLeaf ? 1.0f : color.a;
+        float weight = filter == ColorFilter::CoverageWeighted ? coverage : 1.0f;
+        sum += glm::vec3(color) * weight;
+        weightSum += weight;
+        covered += coverage;
+    }
+    // Without weighted children the node keeps its own color.
+    glm::vec3 rgb = weightSum > 0.0f ? sum / weightSum : glm::vec3(UnpackColor(m_colors[nodeIndex]));
+    return PackColor(glm::vec4(rgb, covered / 8.0f));
+}
+
+void SparseVoxelOctree::RefilterPath(const int* path, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if (m_nodes[path[i]].IsLeaf)
+            continue;
+        m_colors[path[i]] = FilteredColor(path[i], m_colorFilter);
+        MarkDirty(path[i]);
+    }
+}
@@ -0,0 +1,75 @@
+#include "Octree.h"
+#include "Atomic.h"
+#include <iostream>
+
+void SparseVoxelOctree::BeginConcurrentInsert() {
+    m_nodes.BeginConcurrent();
+    m_colors.BeginConcurrent();
+}
+
+void SparseVoxelOctree::InsertConcurrent(glm::vec3 point, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot insert into an octree with merged subtrees" << std::endl;
+        return;
+    }
+    glm::ivec3 target(point);
+    uint32_t packed = PackColor(color);
+    int nodeIndex = 0;
+    glm::ivec3 position(0);
+    // A node this thread allocated for a slot another thread filled first;
+    // it is used for the next empty slot instead.
+    int spare = -1;
+    for (int depth = 0;; depth++) {
+        FlattenedNode& node = m_nodes.AtConcurrent(nodeIndex);
+        if (depth < m_maxDepth && AtomicLoad(&node.IsLeaf))
+            break;
+        AtomicStore(&m_colors.AtConcurrent(nodeIndex), packed);
+        if (depth == m_maxDepth) {
+            AtomicStore(&node.IsLeaf, true);
+            break;
+        }
+        int* slot = &node.childIndices[ChildOctant(target, position, m_halfSizes[depth])];
+        int child = AtomicLoad(slot);
+        if (child == -1) {
+            int created = spare != -1 ? spare : AllocateConcurrent();
+            if (AtomicCompareExchange(slot, child, created)) {
+                child = created;
+                spare = -1;
+            } else {
+                spare = created; // child now holds the winner's node
+            }
+        }
+        nodeIndex = child;
+    }
+    if (spare != -1)
+        PushOrphan(spare);
+}
+
+void SparseVoxelOctree::EndConcurrentInsert() {
+    m_nodes.EndConcurrent();
+    m_colors.EndConcurrent();
+    for (int index = m_orphanHead; index != -1;) {
+        int next = m_nodes[index].childIndices[0];
+        m_nodes[index] = FlattenedNode();
+        m_freeNodes.push_back(index);
+        index = next;
+    }
+    m_orphanHead = -1;
+    MarkAllDirty();
+}
+
+int SparseVoxelOctree::AllocateConcurrent() {
+    // Fresh arena slots are value-initialized, so the node is already an
+    // empty interior node.
+    size_t index = m_nodes.AppendConcurrent(1);
+    m_colors.EnsureConcurrent(index, 1);
+    return static_cast<int>(index);
+}
+
+void SparseVoxelOctree::PushOrphan(int nodeIndex) {
+    // Nothing is popped until every thread is done, so there is no ABA.
+    int head = AtomicLoad(&m_orphanHead);
+    do {
+        m_nodes.AtConcurrent(nodeIndex).childIndices[0] = head;
+    } while (!AtomicCompareExchange(&m_orphanHead, head, nodeIndex));
+}
@@ -0,0 +1,176 @@
+#include "Octree.h"
+#include "CsgShape.h"
+#include <iostream>
+
+bool SparseVoxelOctree::Combine(const SparseVoxelOctree& other, CsgOp op) {
+    if (m_merged) {
+        std::cout << "Cannot edit an octree with merged subtrees" << std::endl;
+        return false;
+    }
+    if (other.m_size != m_size || other.m_maxDepth != m_maxDepth) {
+        std::cout << "Cannot combine octrees of different size or depth" << std::endl;
+        return false;
+    }
+    if (&other == this) {
+        std::cout << "Cannot combine an octree with itself" << std::endl;
+        return false;
+    }
+    if (!CombineImpl(0, other, 0, op, 0)) {
+        // The root stays, empty.
+        ClearChildren(0);
+        m_nodes[0].IsLeaf = false;
+        int root = 0;
+        RefilterPath(&root, 1);
+    }
+    return true;
+}
+
+bool SparseVoxelOctree::Combine(const CsgShape& shape, CsgOp op, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot edit an octree with merged subtrees" << std::endl;
+        return false;
+    }
+    if (!CombineShapeImpl(0, shape, op, PackColor(color), glm::ivec3(0), glm::ivec3(m_size), 0)) {
+        ClearChildren(0);
+        m_nodes[0].IsLeaf = false;
+        int root = 0;
+        RefilterPath(&root, 1);
+    }
+    return true;
+}
+
+bool SparseVoxelOctree::CombineImpl(int nodeIndex, const SparseVoxelOctree& other, int otherIndex, CsgOp op, int depth) {
+    const FlattenedNode& otherNode = other.m_nodes[otherIndex];
+    if (otherNode.IsLeaf) {
+        // other is solid over the whole cell.
+        if (op == CsgOp::Subtract)
+            return false;
+        if (op == CsgOp::Union) {
+            ClearChildren(nodeIndex);
+            m_nodes[nodeIndex].IsLeaf = true;
+            m_colors[nodeIndex] = other.m_colors[otherIndex];
+        }
+        return HasContent(nodeIndex);
+    }
+    // An interior node at maxDepth is empty.
+    if (depth == m_maxDepth)
+        return op != CsgOp::Intersect && HasContent(nodeIndex);
+
+    // other has detail here. A leaf on this side is split so other's shape
+    // and, for a union, its colors carry through.
+    if (m_nodes[nodeIndex].IsLeaf)
+        SplitLeaf(nodeIndex);
+    MarkDirty(nodeIndex);
+    for (int octant = 0; octant < 8; octant++) {
+        int child = m_nodes[nodeIndex].childIndices[octant];
+        int otherChild = otherNode.childIndices[octant];
+        if (otherChild == -1) {
+            if (op == CsgOp::Intersect && child != -1) {
+                FreeSubtree(child);
+                m_nodes[nodeIndex].childIndices[octant] = -1;
+            }
+            continue;
+        }
+        if (child == -1) {
+            if (op == CsgOp::Union)
+                m_nodes[nodeIndex].childIndices[octant] = CopySubtree(other, otherChild);
+            continue;
+        }
+        if (!CombineImpl(child, other, otherChild, op, depth + 1)) {
+            FreeSubtree(child);
+            m_nodes[nodeIndex].childIndices[octant] = -1;
+        }
+    }
+    if (m_collapseOnInsert)
+        TryCollapse(nodeIndex, true);
+    // Bottom up along every path the operation took.
+    RefilterPath(&nodeIndex, 1);
+    return HasContent(nodeIndex);
+}
+
+bool SparseVoxelOctree::CombineShapeImpl(int nodeIndex, const CsgShape& shape, CsgOp op, uint32_t color,
+                                         glm::ivec3 lo, glm::ivec3 hi, int depth) {
+    // Voxels go by their center; larger cells by their whole box, which is
+    // never wrong and only ever costs a descent.
+    CsgShape::Coverage coverage;
+    if (depth == m_maxDepth)
+        coverage = shape.Contains(glm::vec3(lo + hi) * 0.5f) ? CsgShape::Coverage::Full : CsgShape::Coverage::None;
+    else
+        coverage = shape.Classify(glm::vec3(lo), glm::vec3(hi));
+
+    if (coverage == CsgShape::Coverage::None)
+        return op != CsgOp::Intersect && HasContent(nodeIndex);
+    if (coverage == CsgShape::Coverage::Full) {
+        if (op == CsgOp::Subtract)
+            return false;
+        if (op == CsgOp::Union) {
+            ClearChildren(nodeIndex);
+            m_nodes[nodeIndex].IsLeaf = true;
+            m_colors[nodeIndex] = color;
+            MarkDirty(nodeIndex);
+        }
+        return HasContent(nodeIndex);
+    }
+
+    if (m_nodes[nodeIndex].IsLeaf) {
+        if (op == CsgOp::Union && m_colors[nodeIndex] == color)
+            return true;
+        SplitLeaf(nodeIndex);
+    }
+    MarkDirty(nodeIndex);
+    int half = m_halfSizes[depth];
+    for (int octant = 0; octant < 8; octant++) {
+        glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+        glm::ivec3 childLo = lo + offset * half;
+        glm::ivec3 childHi = glm::mix(lo + glm::ivec3(half), hi, glm::equal(offset, glm::ivec3(1)));
+        int child = m_nodes[nodeIndex].childIndices[octant];
+        if (child == -1) {
+            // Only a union can add to an empty cell.
+            if (op != CsgOp::Union || glm::any(glm::greaterThanEqual(childLo, childHi)))
+                continue;
+            child = AllocateNode();
+            m_nodes[nodeIndex].childIndices[octant] = child;
+        }
+        if (!CombineShapeImpl(child, shape, op, color, childLo, childHi, depth + 1)) {
+            FreeSubtree(child);
+            m_nodes[nodeIndex].childIndices[octant] = -1;
+        }
+    }
+    if (m_collapseOnInsert)
+        TryCollapse(nodeIndex, true);
+    // Bottom up along every path the operation took.
+    RefilterPath(&nodeIndex, 1);
+    return HasContent(nodeIndex);
+}
+
+int SparseVoxelOctree::CopySubtree(const SparseVoxelOctree& other, int otherIndex) {
+    int nodeIndex = AllocateNode();
+    m_nodes[nodeIndex].IsLeaf = other.m_nodes[otherIndex].IsLeaf;
+    m_colors[nodeIndex] = other.m_colors[otherIndex];
+    for (int octant = 0; octant < 8; octant++) {
+        int otherChild = other.m_nodes[otherIndex].childIndices[octant];
+        if (otherChild != -1)
+            m_nodes[nodeIndex].childIndices[octant] = CopySubtree(other, otherChild);
+    }
+    return nodeIndex;
+}
+
+void SparseVoxelOctree::ClearChildren(int nodeIndex) {
+    for (int& child : m_nodes[nodeIndex].childIndices) {
+        if (child != -1)
+            FreeSubtree(child);
+        child = -1;
+    }
+    MarkDirty(nodeIndex);
+}
+
+bool SparseVoxelOctree::HasContent(int nodeIndex) const {
+    const FlattenedNode& node = m_nodes[nodeIndex];
+    if (node.IsLeaf)
+        return true;
+    for (int child : node.childIndices) {
+        if (child != -1)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,108 @@
+#include "Octree.h"
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// A node with its children replaced by the ids of their merged subtrees, so
+// two nodes with equal keys root identical subtrees.
+struct SubtreeKey {
+    int children[8];
+    uint32_t color;
+    bool isLeaf;
+
+    bool operator==(const SubtreeKey& other) const {
+        return isLeaf == other.isLeaf && color == other.color &&
+               std::memcmp(children, other.children, sizeof(children)) == 0;
+    }
+};
+
+struct SubtreeKeyHash {
+    size_t operator()(const SubtreeKey& key) const {
+        uint64_t hash = key.color * 0x9E3779B97F4A7C15ull + key.isLeaf;
+        for (int child : key.children) {
+            hash ^= static_cast<uint32_t>(child) + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+        }
+        return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+};
+
+} // namespace
+
+std::vector<int> SparseVoxelOctree::SubtreeIds(std::vector<int>& representatives) const {
+    // Post-order walk from the root, so every child has its id before its
+    // parent is hashed. canonical doubles as the visited set, which also
+    // makes running this on an already merged tree safe.
+    std::vector<int> canonical(m_nodes.size(), -1);
+    representatives.clear();
+    std::unordered_map<SubtreeKey, int, SubtreeKeyHash> ids;
+    ids.reserve(m_nodes.size());
+
+    struct Frame {
+        int node;
+        int nextChild;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({0, 0});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        const FlattenedNode& node = m_nodes[frame.node];
+        if (frame.nextChild < 8) {
+            int child = node.childIndices[frame.nextChild++];
+            if (child != -1 && canonical[child] == -1)
+                stack.push_back({child, 0});
+            continue;
+        }
+        SubtreeKey key;
+        key.isLeaf = node.IsLeaf;
+        key.color = m_colors[frame.node];
+        for (int i = 0; i < 8; i++)
+            key.children[i] = node.childIndices[i] == -1 ? -1 : canonical[node.childIndices[i]];
+        auto inserted = ids.emplace(key, static_cast<int>(representatives.size()));
+        if (inserted.second)
+            representatives.push_back(frame.node);
+        canonical[frame.node] = inserted.first->second;
+        stack.pop_back();
+    }
+    return canonical;
+}
+
+size_t SparseVoxelOctree::MergeIdenticalSubtrees() {
+    size_t oldCount = m_nodes.size();
+    std::vector<int> representatives;
+    std::vector<int> canonical = SubtreeIds(representatives);
+
+    // Re-emit one node per id, breadth first from the root, so the shared
+    // array keeps siblings close together.
+    std::vector<int> newIndex(representatives.size(), -1);
+    std::vector<int> order;
+    order.reserve(representatives.size());
+    newIndex[canonical[0]] = 0;
+    order.push_back(canonical[0]);
+    NodeArena<FlattenedNode> nodes;
+    NodeArena<uint32_t> colors;
+    for (size_t i = 0; i < order.size(); i++) {
+        int source = representatives[order[i]];
+        FlattenedNode node = m_nodes[source];
+        for (int& child : node.childIndices) {
+            if (child == -1)
+                continue;
+            int id = canonical[child];
+            if (newIndex[id] == -1) {
+                newIndex[id] = static_cast<int>(order.size());
+                order.push_back(id);
+            }
+            child = newIndex[id];
+        }
+        nodes.push_back(node);
+        colors.push_back(m_colors[source]);
+    }
+
+    m_nodes.swap(nodes);
+    m_colors.swap(colors);
+    // Free slots pointed into the old arrays.
+    m_freeNodes.clear();
+    m_merged = true;
+    MarkAllDirty();
+    return oldCount - m_nodes.size();
+}
@@ -0,0 +1,136 @@
+#include "Octree.h"
+#include <algorithm>
+#include <iostream>
+
+bool SparseVoxelOctree::Remove(glm::ivec3 point) {
+    if (m_merged) {
+        std::cout << "Cannot edit an octree with merged subtrees" << std::endl;
+        return false;
+    }
+    if (m_maxDepth >= 64) {
+        std::cout << "Edits support at most 63 levels" << std::endl;
+        return false;
+    }
+    // path[depth] is the node holding point at that depth and octants[depth]
+    // its slot in path[depth - 1].
+    int path[64];
+    int octants[64];
+    path[0] = 0;
+    glm::ivec3 position(0);
+    int depth = 0;
+    for (;; depth++) {
+        int nodeIndex = path[depth];
+        if (m_nodes[nodeIndex].IsLeaf) {
+            if (depth == m_maxDepth)
+                break;
+            SplitLeaf(nodeIndex);
+        }
+        if (depth == m_maxDepth)
+            return false;
+        int octant = ChildOctant(point, position, m_halfSizes[depth]);
+        int child = m_nodes[nodeIndex].childIndices[octant];
+        if (child == -1)
+            return false;
+        path[depth + 1] = child;
+        octants[depth + 1] = octant;
+    }
+
+    if (depth == 0) {
+        // A one-level tree: the root itself is the voxel.
+        m_nodes[0].IsLeaf = false;
+        MarkDirty(0);
+        return true;
+    }
+    // Unlink the leaf, then each ancestor it leaves empty. The root stays.
+    for (; depth > 0; depth--) {
+        int parent = path[depth - 1];
+        FreeSubtree(path[depth]);
+        m_nodes[parent].childIndices[octants[depth]] = -1;
+        MarkDirty(parent);
+        bool empty = true;
+        for (int child : m_nodes[parent].childIndices)
+            empty = empty && child == -1;
+        if (!empty)
+            break;
+    }
+    // path[depth] was freed; everything above it lost part of its cube.
+    RefilterPath(path, std::max(depth, 1));
+    return true;
+}
+
+bool SparseVoxelOctree::SetColor(glm::ivec3 point, glm::vec4 color) {
+    if (m_merged) {
+        std::cout << "Cannot edit an octree with merged subtrees" << std::endl;
+        return false;
+    }
+    if (m_maxDepth >= 64) {
+        std::cout << "Edits support at most 63 levels" << std::endl;
+        return false;
+    }
+    uint32_t packed = PackColor(color);
+    int path[64];
+    path[0] = 0;
+    glm::ivec3 position(0);
+    int depth = 0;
+    for (;; depth++) {
+        int nodeIndex = path[depth];
+        if (m_nodes[nodeIndex].IsLeaf) {
+            if (m_colors[nodeIndex] == packed)
+                return true;
+            if (depth == m_maxDepth)
+                break;
+            SplitLeaf(nodeIndex);
+        }
+        if (depth == m_maxDepth)
+            return false;
+        int child = m_nodes[nodeIndex].childIndices[ChildOctant(point, position, m_halfSizes[depth])];
+        if (child == -1)
+            return false;
+        path[depth + 1] = child;
+    }
+    m_colors[path[depth]] = packed;
+    MarkDirty(path[depth]);
+    if (m_collapseOnInsert) {
+        // Only nodes on the edited path can have become uniform.
+        for (int d = depth - 1; d >= 0; d--) {
+            if (!TryCollapse(path[d], true))
+                break;
+        }
+    }
+    RefilterPath(path, depth);
+    return true;
+}
+
+std::vector<SparseVoxelOctree::NodeRange> SparseVoxelOctree::TakeDirtyRanges() {
+    std::vector<NodeRange> ranges;
+    size_t count = m_nodes.size();
+    if (m_allDirty) {
+        if (count > 0)
+            ranges.push_back({0, count});
+    } else {
+        // Runs of set bits become ranges; a run may cross word boundaries.
+        size_t pageNodes = size_t(1) << DirtyPageBits;
+        size_t pages = m_dirtyPages.size() * 64;
+        for (size_t page = 0; page < pages;) {
+            uint64_t word = m_dirtyPages[page >> 6] >> (page & 63);
+            if (word == 0) {
+                page = (page | 63) + 1;
+                continue;
+            }
+            if (!(word & 1)) {
+                page++;
+                continue;
+            }
+            size_t first = page;
+            while (page < pages && ((m_dirtyPages[page >> 6] >> (page & 63)) & 1))
+                page++;
+            size_t begin = first * pageNodes;
+            size_t end = std::min(page * pageNodes, count);
+            if (begin < end)
+                ranges.push_back({begin, end - begin});
+        }
+    }
+    m_allDirty = false;
+    m_dirtyPages.clear();
+    return ranges;
+}
@@ -0,0 +1,128 @@
+#include "OctreeFile.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+uint64_t AlignUp(uint64_t offset) {
+    return (offset + OctreeFileHeader::Alignment - 1) / OctreeFileHeader::Alignment * OctreeFileHeader::Alignment;
+}
+
+void WritePadding(std::ofstream& out, uint64_t offset) {
+    static const char zeros[OctreeFileHeader::Alignment] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    if (offset > position)
+        out.write(zeros, static_cast<std::streamsize>(offset - position));
+}
+
+} // namespace
+
+bool OctreeFile::Save(const SparseVoxelOctree& octree, const std::string& path, uint32_t seed, uint32_t generator) {
+    OctreeFileHeader header = {};
+    std::memcpy(header.magic, "SVOCTREE", sizeof(header.magic));
+    header.version = OctreeFileHeader::Version;
+    header.headerSize = sizeof(OctreeFileHeader);
+    header.nodeFormat = OctreeFileHeader::FlattenedNodes;
+    header.nodeSize = sizeof(FlattenedNode);
+    header.size = octree.Size();
+    header.maxDepth = octree.MaxDepth();
+    header.seed = seed;
+    header.flags = octree.IsMerged() ? OctreeFileHeader::MergedFlag : 0;
+    header.generator = generator;
+    header.nodeCount = octree.Nodes().size();
+    header.nodeOffset = AlignUp(sizeof(OctreeFileHeader));
+    header.colorOffset = AlignUp(header.nodeOffset + header.nodeCount * sizeof(FlattenedNode));
+
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "Could not write " << temporary << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    WritePadding(out, header.nodeOffset);
+    octree.Nodes().ForEachBlock([&](const FlattenedNode* data, size_t, size_t count) {
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(FlattenedNode)));
+    });
+    WritePadding(out, header.colorOffset);
+    octree.Colors().ForEachBlock([&](const uint32_t* data, size_t, size_t count) {
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+    });
+    out.close();
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cout << "Could not write " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool OctreeFile::Open(const std::string& path) {
+    // Loading reads the whole file front to back.
+    if (!m_file.Open(path, true))
+        return false;
+
+    const char* problem = nullptr;
+    size_t length = m_file.Length();
+    if (length < sizeof(OctreeFileHeader) || std::memcmp(Header().magic, "SVOCTREE", sizeof(Header().magic)) != 0) {
+        problem = "not an octree file";
+    } else {
+        const OctreeFileHeader& header = Header();
+        uint64_t nodeEnd = header.nodeOffset + header.nodeCount * sizeof(FlattenedNode);
+        uint64_t colorEnd = header.colorOffset + header.nodeCount * sizeof(uint32_t);
+        if (header.version != OctreeFileHeader::Version || header.headerSize != sizeof(OctreeFileHeader))
+            problem = "unsupported version";
+        else if (header.nodeFormat != OctreeFileHeader::FlattenedNodes || header.nodeSize != sizeof(FlattenedNode))
+            problem = "unsupported node format";
+        else if (header.nodeCount == 0 || header.nodeCount > (uint64_t(1) << 31) ||
+                 header.nodeOffset % OctreeFileHeader::Alignment != 0 ||
+                 header.colorOffset % OctreeFileHeader::Alignment != 0 ||
+                 nodeEnd > length || colorEnd > length)
+            problem = "truncated or corrupt";
+    }
+    if (problem) {
+        std::cout << path << ": " << problem << std::endl;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool OctreeFile::Matches(int size, int maxDepth, uint32_t seed, uint32_t generator) const {
+    return IsOpen() && Header().size == size && Header().maxDepth == maxDepth && Header().seed == seed &&
+           Header().generator == generator;
+}
+
+bool SparseVoxelOctree::Load(const OctreeFile& file) {
+    if (!file.IsOpen())
+        return false;
+    if (file.Header().size != m_size || file.Header().maxDepth != m_maxDepth) {
+        std::cout << "Octree file has size " << file.Header().size << " and depth " << file.Header().maxDepth
+                  << ", expected " << m_size << " and " << m_maxDepth << std::endl;
+        return false;
+    }
+    // Traversals trust every child index, so a corrupt payload is rejected
+    // before it replaces the tree. The leaf flag is read as a byte, since a
+    // bool holding anything but 0 or 1 is undefined.
+    const FlattenedNode* nodes = file.Nodes();
+    int64_t nodeCount = static_cast<int64_t>(file.NodeCount());
+    for (int64_t i = 0; i < nodeCount; i++) {
+        unsigned char isLeaf;
+        std::memcpy(&isLeaf, &nodes[i].IsLeaf, 1);
+        bool valid = isLeaf <= 1;
+        for (int child : nodes[i].childIndices)
+            valid = valid && (child == -1 || (child > 0 && child < nodeCount));
+        if (!valid) {
+            std::cout << "Octree file has a corrupt node at " << i << std::endl;
+            return false;
+        }
+    }
+    m_nodes.assign(file.Nodes(), file.NodeCount());
+    m_colors.assign(file.Colors(), file.NodeCount());
+    m_merged = (file.Header().flags & OctreeFileHeader::MergedFlag) != 0;
+    m_freeNodes.clear();
+    MarkAllDirty();
+    return true;
+}
@@ -0,0 +1,261 @@
+#include "Octree.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+namespace {
+
+// Filled cells of a heightfield sample, as maxDepth cell indices along y.
+struct SampleSpan {
+    int bottom;
+    int top; // Inclusive
+    uint32_t color;
+};
+
+// What a pyramid entry knows about the columns under it. A node is empty if
+// its cells lie wholly above highestTop or below lowestBottom, and solid if
+// every column fills it: below highestBottom up to lowestTop.
+struct ColumnBounds {
+    int lowestBottom = INT_MAX;
+    int highestTop = INT_MIN;
+    int highestBottom = INT_MAX;
+    int lowestTop = INT_MIN;
+    uint32_t color = 0;
+    bool uniform = false; // Every sample has color
+    bool empty = true;    // No samples at all
+    int lastSample = -1;
+};
+
+ColumnBounds Merge(const ColumnBounds& a, const ColumnBounds& b) {
+    if (a.empty && b.empty)
+        return a;
+    if (a.empty || b.empty) {
+        // A column without samples has no solid cells, so the pair can't be
+        // full anywhere. Such columns appear wherever the sample spacing
+        // doesn't match the uneven cell widths.
+        ColumnBounds merged = a.empty ? b : a;
+        merged.highestBottom = INT_MAX;
+        merged.lowestTop = INT_MIN;
+        return merged;
+    }
+    ColumnBounds merged;
+    merged.lowestBottom = std::min(a.lowestBottom, b.lowestBottom);
+    merged.highestTop = std::max(a.highestTop, b.highestTop);
+    merged.highestBottom = std::max(a.highestBottom, b.highestBottom);
+    merged.lowestTop = std::min(a.lowestTop, b.lowestTop);
+    merged.color = a.color;
+    merged.uniform = a.uniform && b.uniform && a.color == b.color;
+    merged.lastSample = std::max(a.lastSample, b.lastSample);
+    merged.empty = false;
+    return merged;
+}
+
+} // namespace
+
+int SparseVoxelOctree::AxisCell(int coord) const {
+    int cell = 0;
+    int position = 0;
+    for (int depth = 0; depth < m_maxDepth; depth++) {
+        int bit = (coord >= position + m_halfSizes[depth]) ? 1 : 0;
+        cell = cell << 1 | bit;
+        position += bit * m_halfSizes[depth];
+    }
+    return cell;
+}
+
+void SparseVoxelOctree::BuildFromHeightfield(const Heightfield& field, float depthBelow) {
+    if (m_maxDepth > 15) {
+        std::cout << "BuildFromHeightfield supports at most 15 levels" << std::endl;
+        return;
+    }
+    m_merged = false;
+    m_freeNodes.clear();
+    MarkAllDirty();
+    m_nodes.clear();
+    m_colors.clear();
+
+    // Samples grouped by the maxDepth column they fall in, in sample order,
+    // which is the order main lists their voxels in; later ones win colors.
+    int cells = 1 << m_maxDepth;
+    std::vector<int> axisCells(m_size);
+    for (int coord = 0; coord < m_size; coord++)
+        axisCells[coord] = AxisCell(coord);
+    auto cellOf = [&](float position) {
+        int coord = static_cast<int>(position);
+        return coord < 0 ? 0 : coord >= m_size ? cells - 1 : axisCells[coord];
+    };
+    int samples = field.Samples();
+    std::vector<SampleSpan> spans(static_cast<size_t>(samples) * samples);
+    std::vector<int> columnOf(spans.size());
+    std::vector<int> columnStart(static_cast<size_t>(cells) * cells + 1, 0);
+    for (int ix = 0; ix < samples; ix++) {
+        for (int iz = 0; iz < samples; iz++) {
+            size_t sample = static_cast<size_t>(ix) * samples + iz;
+            float height = field.Height(ix, iz);
+            spans[sample] = {cellOf(height - depthBelow), cellOf(height), field.Color(ix, iz)};
+            columnOf[sample] = cellOf(ix * field.Spacing()) * cells + cellOf(iz * field.Spacing());
+            columnStart[columnOf[sample] + 1]++;
+        }
+    }
+    for (size_t column = 0; column + 1 < columnStart.size(); column++)
+        columnStart[column + 1] += columnStart[column];
+    std::vector<int> columnSamples(spans.size());
+    std::vector<int> cursor(columnStart.begin(), columnStart.end() - 1);
+    for (size_t sample = 0; sample < spans.size(); sample++)
+        columnSamples[cursor[columnOf[sample]]++] = static_cast<int>(sample);
+
+    // Level d holds 2^d x 2^d entries, one per column of nodes at depth d.
+    std::vector<std::vector<ColumnBounds>> pyramid(m_maxDepth + 1);
+    pyramid[m_maxDepth].resize(static_cast<size_t>(cells) * cells);
+    std::vector<SampleSpan> merged;
+    for (size_t column = 0; column < pyramid[m_maxDepth].size(); column++) {
+        ColumnBounds& bounds = pyramid[m_maxDepth][column];
+        merged.clear();
+        for (int i = columnStart[column]; i < columnStart[column + 1]; i++) {
+            const SampleSpan& span = spans[columnSamples[i]];
+            if (bounds.empty) {
+                bounds.lowestBottom = span.bottom;
+                bounds.highestTop = span.top;
+                bounds.color = span.color;
+                bounds.uniform = true;
+                bounds.empty = false;
+            }
+            bounds.lowestBottom = std::min(bounds.lowestBottom, span.bottom);
+            bounds.highestTop = std::max(bounds.highestTop, span.top);
+            bounds.uniform = bounds.uniform && span.color == bounds.color;
+            bounds.lastSample = columnSamples[i];
+            merged.push_back(span);
+        }
+        // Several samples can land in one column. Where their spans overlap
+        // or touch they fill one run; the longest run is what counts as
+        // solid for the whole column.
+        std::sort(merged.begin(), merged.end(), [](const SampleSpan& a, const SampleSpan& b) { return a.bottom < b.bottom; });
+        int runBottom = 0;
+        int runTop = -1;
+        int longest = -1;
+        for (size_t i = 0; i < merged.size(); i++) {
+            if (i == 0 || merged[i].bottom > runTop + 1) {
+                runBottom = merged[i].bottom;
+                runTop = merged[i].top;
+            } else {
+                runTop = std::max(runTop, merged[i].top);
+            }
+            if (runTop - runBottom > longest) {
+                longest = runTop - runBottom;
+                bounds.highestBottom = runBottom;
+                bounds.lowestTop = runTop;
+            }
+        }
+    }
+    for (int depth = m_maxDepth - 1; depth >= 0; depth--) {
+        int width = 1 << depth;
+        pyramid[depth].resize(static_cast<size_t>(width) * width);
+        const std::vector<ColumnBounds>& below = pyramid[depth + 1];
+        for (int x = 0; x < width; x++) {
+            for (int z = 0; z < width; z++) {
+                auto child = [&](int dx, int dz) -> const ColumnBounds& {
+                    return below[static_cast<size_t>(2 * x + dx) * (2 * width) + 2 * z + dz];
+                };
+                pyramid[depth][static_cast<size_t>(x) * width + z] =
+                    Merge(Merge(child(0, 0), child(0, 1)), Merge(child(1, 0), child(1, 1)));
+            }
+        }
+    }
+
+    // Nodes are collected per depth in the order a depth-first walk closes
+    // them, which within a depth is Morton order: the breadth-first layout
+    // Build emits, once the depths are laid end to end. Each node's color is
+    // that of the last sample with a voxel under it.
+    std::vector<std::vector<FlattenedNode>> levels(m_maxDepth + 1);
+    std::vector<std::vector<uint32_t>> levelColors(m_maxDepth + 1);
+    std::vector<std::vector<int>> levelSamples(m_maxDepth + 1); // Last sample under each node
+    // Returns the node's index within its depth, or -1 if it is empty.
+    auto emit = [&](auto& self, int depth, glm::ivec3 cell) -> int {
+        const ColumnBounds& bounds = pyramid[depth][static_cast<size_t>(cell.x) * (1 << depth) + cell.z];
+        int bottom = cell.y << (m_maxDepth - depth);
+        int top = ((cell.y + 1) << (m_maxDepth - depth)) - 1;
+        if (bounds.empty || bounds.highestTop < bottom || bounds.lowestBottom > top)
+            return -1;
+        FlattenedNode node{};
+        uint32_t color = 0;
+        int lastSample = -1;
+        if (depth == m_maxDepth) {
+            int column = cell.x * cells + cell.z;
+            for (int i = columnStart[column]; i < columnStart[column + 1]; i++) {
+                const SampleSpan& span = spans[columnSamples[i]];
+                if (span.bottom <= cell.y && cell.y <= span.top)
+                    lastSample = columnSamples[i];
+            }
+            if (lastSample == -1)
+                return -1;
+            node.IsLeaf = true;
+            color = spans[lastSample].color;
+        } else if (m_collapseOnInsert && bounds.uniform && bounds.highestBottom <= bottom && bounds.lowestTop >= top) {
+            node.IsLeaf = true;
+            color = bounds.color;
+            lastSample = bounds.lastSample;
+        } else {
+            std::vector<FlattenedNode>& below = levels[depth + 1];
+            std::vector<uint32_t>& belowColors = levelColors[depth + 1];
+            bool uniformLeaves = true;
+            for (int octant = 0; octant < 8; octant++) {
+                glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+                int child = self(self, depth + 1, cell * 2 + offset);
+                node.childIndices[octant] = child;
+                if (child == -1) {
+                    uniformLeaves = false;
+                    continue;
+                }
+                if (levelSamples[depth + 1][child] > lastSample) {
+                    lastSample = levelSamples[depth + 1][child];
+                    color = belowColors[child];
+                }
+                uniformLeaves = uniformLeaves && below[child].IsLeaf && belowColors[child] == belowColors[node.childIndices[0]];
+            }
+            if (lastSample == -1)
+                return -1;
+            // The footprint test misses solid nodes whose columns are filled
+            // by several disjoint samples; catch those once their children
+            // are known, as TryCollapse would.
+            if (m_collapseOnInsert && uniformLeaves) {
+                below.resize(below.size() - 8);
+                belowColors.resize(belowColors.size() - 8);
+                levelSamples[depth + 1].resize(levelSamples[depth + 1].size() - 8);
+                node = FlattenedNode{};
+                node.IsLeaf = true;
+            }
+        }
+        levels[depth].push_back(node);
+        levelColors[depth].push_back(color);
+        levelSamples[depth].push_back(lastSample);
+        return static_cast<int>(levels[depth].size()) - 1;
+    };
+    if (emit(emit, 0, glm::ivec3(0)) == -1) {
+        levels[0].push_back(FlattenedNode{});
+        levelColors[0].push_back(PackColor(glm::vec4(1.0f)));
+    }
+
+    // Lay the depths end to end and point the children at their new places.
+    size_t total = 0;
+    for (const std::vector<FlattenedNode>& level : levels)
+        total += level.size();
+    m_nodes.resize(total);
+    m_colors.resize(total);
+    size_t index = 0;
+    for (int depth = 0; depth <= m_maxDepth; depth++) {
+        int childOffset = static_cast<int>(index + levels[depth].size());
+        for (size_t i = 0; i < levels[depth].size(); i++, index++) {
+            FlattenedNode& node = m_nodes[index];
+            node = levels[depth][i];
+            for (int& child : node.childIndices) {
+                if (child != -1)
+                    child += childOffset;
+            }
+            m_colors[index] = levelColors[depth][i];
+        }
+        // Free each depth once copied, so peak memory stays near one tree.
+        levels[depth] = std::vector<FlattenedNode>();
+        levelColors[depth] = std::vector<uint32_t>();
+    }
+}
@@ -0,0 +1,92 @@
+#include "Octree.h"
+
+void SparseVoxelOctree::Reorder(NodeLayout layout) {
+    // order lists old indices in their new order; newIndex is its inverse
+    // and doubles as the visited set, so shared subtrees are placed once.
+    std::vector<int> newIndex(m_nodes.size(), -1);
+    std::vector<int> order;
+    order.reserve(m_nodes.size());
+    auto place = [&](int node) {
+        newIndex[node] = static_cast<int>(order.size());
+        order.push_back(node);
+    };
+
+    if (layout == NodeLayout::DepthFirst) {
+        // A node's children are placed as one block when the node is
+        // reached, then walked in octant order.
+        place(0);
+        std::vector<int> stack(1, 0);
+        while (!stack.empty()) {
+            int node = stack.back();
+            stack.pop_back();
+            int children[8];
+            int childCount = 0;
+            for (int child : m_nodes[node].childIndices) {
+                if (child != -1 && newIndex[child] == -1) {
+                    place(child);
+                    children[childCount++] = child;
+                }
+            }
+            while (childCount > 0)
+                stack.push_back(children[--childCount]);
+        }
+    } else if (layout == NodeLayout::VanEmdeBoas) {
+        LayoutVanEmdeBoas(0, m_maxDepth + 1, order, newIndex);
+    } else {
+        place(0);
+    }
+    // Breadth first, and a safety net for the van Emde Boas split: anything
+    // not placed yet follows in breadth-first order.
+    for (size_t i = 0; i < order.size(); i++) {
+        for (int child : m_nodes[order[i]].childIndices) {
+            if (child != -1 && newIndex[child] == -1)
+                place(child);
+        }
+    }
+
+    NodeArena<FlattenedNode> nodes;
+    NodeArena<uint32_t> colors;
+    for (int source : order) {
+        FlattenedNode node = m_nodes[source];
+        for (int& child : node.childIndices) {
+            if (child != -1)
+                child = newIndex[child];
+        }
+        nodes.push_back(node);
+        colors.push_back(m_colors[source]);
+    }
+    m_nodes.swap(nodes);
+    m_colors.swap(colors);
+    m_freeNodes.clear();
+    MarkAllDirty();
+}
+
+void SparseVoxelOctree::LayoutVanEmdeBoas(int root, int levels, std::vector<int>& order,
+                                          std::vector<int>& newIndex) const {
+    if (levels <= 1) {
+        if (newIndex[root] == -1) {
+            newIndex[root] = static_cast<int>(order.size());
+            order.push_back(root);
+        }
+        return;
+    }
+    int topLevels = levels / 2;
+    LayoutVanEmdeBoas(root, topLevels, order, newIndex);
+
+    // The roots of the bottom subtrees are the nodes topLevels below root.
+    std::vector<int> frontier(1, root);
+    for (int level = 0; level < topLevels; level++) {
+        std::vector<int> next;
+        for (int node : frontier) {
+            for (int child : m_nodes[node].childIndices) {
+                if (child != -1)
+                    next.push_back(child);
+            }
+        }
+        frontier.swap(next);
+    }
+    for (int node : frontier) {
+        if (newIndex[node] == -1)
+            LayoutVanEmdeBoas(node, levels - topLevels, order, newIndex);
+    }
+}
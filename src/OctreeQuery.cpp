@@ -0,0 +1,156 @@
+#include "Octree.h"
+#include <algorithm>
+
+bool SparseVoxelOctree::FindGround(glm::ivec3 from, int* height, glm::vec4* color) const {
+    if (from.x < 0 || from.z < 0 || from.x >= m_size || from.z >= m_size || from.y < 0 || m_maxDepth >= 64)
+        return false;
+    glm::ivec3 point(from.x, std::min(from.y, m_size - 1), from.z);
+    // The path to the cell holding point. Stepping down past an empty cell
+    // backs up only to the first ancestor that still contains the new point.
+    int nodes[64];
+    glm::ivec3 lo[64];
+    glm::ivec3 hi[64];
+    nodes[0] = 0;
+    lo[0] = glm::ivec3(0);
+    hi[0] = glm::ivec3(m_size);
+    int depth = 0;
+    for (;;) {
+        const FlattenedNode& node = m_nodes[nodes[depth]];
+        if (node.IsLeaf) {
+            // A collapsed leaf covers voxels split the same way as the
+            // tree; only the one holding point matters, and only along y.
+            int top = hi[depth].y;
+            int bottom = lo[depth].y;
+            for (int d = depth; d < m_maxDepth; d++) {
+                if (point.y >= bottom + m_halfSizes[d])
+                    bottom += m_halfSizes[d];
+                else
+                    top = bottom + m_halfSizes[d];
+            }
+            *height = top;
+            if (color)
+                *color = UnpackColor(m_colors[nodes[depth]]);
+            return true;
+        }
+        if (depth < m_maxDepth) {
+            int half = m_halfSizes[depth];
+            glm::ivec3 position = lo[depth];
+            int octant = ChildOctant(point, position, half);
+            int child = node.childIndices[octant];
+            if (child != -1) {
+                glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+                hi[depth + 1] = glm::mix(lo[depth] + glm::ivec3(half), hi[depth], glm::equal(offset, glm::ivec3(1)));
+                lo[depth + 1] = position;
+                nodes[++depth] = child;
+                continue;
+            }
+            // Skip the whole empty child.
+            point.y = position.y - 1;
+        } else {
+            point.y = lo[depth].y - 1; // An interior node at maxDepth is empty
+        }
+        if (point.y < 0)
+            return false;
+        while (point.y < lo[depth].y)
+            depth--;
+    }
+}
+
+size_t SparseVoxelOctree::FindNearest(glm::vec3 point, float maxDistance, NearestVoxel* nearest, size_t k) const {
+    if (k == 0 || maxDistance < 0.0f || m_maxDepth >= 64)
+        return 0;
+    float limit = maxDistance * maxDistance;
+    size_t found = 0;
+    // Anything within range is taken until there are k; after that it has
+    // to beat the kth best.
+    auto accepts = [&](float distanceSquared) {
+        return found < k ? distanceSquared <= limit : distanceSquared < nearest[k - 1].distanceSquared;
+    };
+    auto distanceTo = [&](glm::ivec3 lo, glm::ivec3 hi) {
+        glm::vec3 d = glm::max(glm::max(glm::vec3(lo) - point, point - glm::vec3(hi)), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    };
+    auto report = [&](glm::ivec3 lo, glm::ivec3 hi, uint32_t color, float distanceSquared) {
+        size_t i = found < k ? found++ : k - 1;
+        for (; i > 0 && nearest[i - 1].distanceSquared > distanceSquared; i--)
+            nearest[i] = nearest[i - 1];
+        nearest[i] = {lo, hi, color, distanceSquared};
+    };
+
+    if (m_maxDepth == 0) {
+        float distanceSquared = distanceTo(glm::ivec3(0), glm::ivec3(m_size));
+        if (m_nodes[0].IsLeaf && accepts(distanceSquared))
+            report(glm::ivec3(0), glm::ivec3(m_size), m_colors[0], distanceSquared);
+        return found;
+    }
+
+    // One frame per level: the node's cell and its children still in reach,
+    // nearest first.
+    struct Frame {
+        int node;
+        glm::ivec3 lo;
+        glm::ivec3 hi;
+        int octants[8];
+        float distances[8];
+        int count;
+        int next;
+    };
+    Frame stack[64];
+    auto childCell = [&](const Frame& frame, int depth, int octant, glm::ivec3& childLo, glm::ivec3& childHi) {
+        int half = m_halfSizes[depth];
+        glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+        childLo = frame.lo + offset * half;
+        childHi = glm::mix(frame.lo + glm::ivec3(half), frame.hi, glm::equal(offset, glm::ivec3(1)));
+    };
+    auto open = [&](int depth, int nodeIndex, glm::ivec3 lo, glm::ivec3 hi) {
+        Frame& frame = stack[depth];
+        frame.node = nodeIndex;
+        frame.lo = lo;
+        frame.hi = hi;
+        frame.count = 0;
+        frame.next = 0;
+        const FlattenedNode& node = m_nodes[nodeIndex];
+        for (int octant = 0; octant < 8; octant++) {
+            // A collapsed leaf stands for all eight of its children.
+            if (!node.IsLeaf && node.childIndices[octant] == -1)
+                continue;
+            glm::ivec3 childLo, childHi;
+            childCell(frame, depth, octant, childLo, childHi);
+            float distanceSquared = distanceTo(childLo, childHi);
+            if (!accepts(distanceSquared))
+                continue;
+            int i = frame.count++;
+            for (; i > 0 && frame.distances[i - 1] > distanceSquared; i--) {
+                frame.octants[i] = frame.octants[i - 1];
+                frame.distances[i] = frame.distances[i - 1];
+            }
+            frame.octants[i] = octant;
+            frame.distances[i] = distanceSquared;
+        }
+    };
+
+    open(0, 0, glm::ivec3(0), glm::ivec3(m_size));
+    int depth = 0;
+    while (depth >= 0) {
+        Frame& frame = stack[depth];
+        // Children are sorted, so once one is out of reach the rest are too.
+        if (frame.next == frame.count || !accepts(frame.distances[frame.next])) {
+            depth--;
+            continue;
+        }
+        int i = frame.next++;
+        int octant = frame.octants[i];
+        const FlattenedNode& node = m_nodes[frame.node];
+        int child = node.IsLeaf ? frame.node : node.childIndices[octant];
+        glm::ivec3 childLo, childHi;
+        childCell(frame, depth, octant, childLo, childHi);
+        if (depth + 1 == m_maxDepth) {
+            if (m_nodes[child].IsLeaf)
+                report(childLo, childHi, m_colors[child], frame.distances[i]);
+            continue;
+        }
+        open(depth + 1, child, childLo, childHi);
+        depth++;
+    }
+    return found;
+}
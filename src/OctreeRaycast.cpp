@@ -0,0 +1,274 @@
+#include "Octree.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OCTREE_RAYCAST_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Zero components would turn the slab test at a face through the origin
+// into 0 * inf; a tiny step gives a huge but finite t instead.
+glm::vec3 SafeDirection(glm::vec3 direction) {
+    return glm::mix(direction, glm::vec3(1e-30f), glm::equal(direction, glm::vec3(0.0f)));
+}
+
+// Visiting octants i ^ order for i = 0..7 never puts a child before one
+// that can block it along a ray with these direction signs.
+int OctantOrder(glm::vec3 direction) {
+    return (direction.x < 0.0f ? 4 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 1 : 0);
+}
+
+void ChildCell(int octant, int half, glm::ivec3 lo, glm::ivec3 hi, glm::ivec3& childLo, glm::ivec3& childHi) {
+    glm::ivec3 offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+    childLo = lo + offset * half;
+    childHi = glm::mix(lo + glm::ivec3(half), hi, glm::equal(offset, glm::ivec3(1)));
+}
+
+#ifdef OCTREE_RAYCAST_AVX2
+struct PacketRays {
+    __m256 originX, originY, originZ;
+    __m256 inverseX, inverseY, inverseZ;
+};
+
+// Lanes of mask whose ray enters [lo, hi) before its best hit so far, with
+// the entry distances in tNear.
+__attribute__((target("avx2"))) inline int EnterPacket(const PacketRays& rays, __m256 best, int mask,
+                                                       glm::ivec3 lo, glm::ivec3 hi, __m256& tNear) {
+    __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(lo.x)), rays.originX), rays.inverseX);
+    __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(hi.x)), rays.originX), rays.inverseX);
+    __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(lo.y)), rays.originY), rays.inverseY);
+    __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(hi.y)), rays.originY), rays.inverseY);
+    __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(lo.z)), rays.originZ), rays.inverseZ);
+    __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(static_cast<float>(hi.z)), rays.originZ), rays.inverseZ);
+    tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+                          _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+    __m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+                                _mm256_max_ps(t0z, t1z));
+    __m256 enters = _mm256_and_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ), _mm256_cmp_ps(tNear, best, _CMP_LT_OQ));
+    return _mm256_movemask_ps(enters) & mask;
+}
+
+// Expands bit i of mask to all ones in lane i.
+__attribute__((target("avx2"))) inline __m256 LaneMask(int mask) {
+    __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i set = _mm256_cmpgt_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), _mm256_setzero_si256());
+    return _mm256_castsi256_ps(set);
+}
+
+// Raycast with one stack for all eight rays, testing every child against
+// the packet instead of stepping through split planes, which differ per
+// ray. A node is entered while any ray still reaches it. A ray whose
+// direction signs match the packet's child order is done at its first hit;
+// the others may find a nearer leaf later, so a hit only replaces one that
+// is further away.
+__attribute__((target("avx2"))) int RaycastPacketAvx2(const SparseVoxelOctree& octree, const RayPacket& packet,
+                                                      RayHit* hits) {
+    const NodeArena<FlattenedNode>& nodes = octree.Nodes();
+    const std::vector<int>& halfSizes = octree.HalfSizes();
+    PacketRays rays;
+    rays.originX = _mm256_loadu_ps(packet.originX);
+    rays.originY = _mm256_loadu_ps(packet.originY);
+    rays.originZ = _mm256_loadu_ps(packet.originZ);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 tiny = _mm256_set1_ps(1e-30f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 directionX = _mm256_loadu_ps(packet.directionX);
+    __m256 directionY = _mm256_loadu_ps(packet.directionY);
+    __m256 directionZ = _mm256_loadu_ps(packet.directionZ);
+    rays.inverseX = _mm256_div_ps(one, _mm256_blendv_ps(directionX, tiny, _mm256_cmp_ps(directionX, zero, _CMP_EQ_OQ)));
+    rays.inverseY = _mm256_div_ps(one, _mm256_blendv_ps(directionY, tiny, _mm256_cmp_ps(directionY, zero, _CMP_EQ_OQ)));
+    rays.inverseZ = _mm256_div_ps(one, _mm256_blendv_ps(directionZ, tiny, _mm256_cmp_ps(directionZ, zero, _CMP_EQ_OQ)));
+    __m256 best = _mm256_loadu_ps(packet.maxDistance);
+
+    glm::vec3 sum(0.0f);
+    for (int lane = 0; lane < 8; lane++)
+        sum += glm::vec3(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+    int order = OctantOrder(sum);
+    int active = 0xFF;
+    int inOrder = 0;
+    for (int lane = 0; lane < 8; lane++) {
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if (OctantOrder(direction) == order)
+            inOrder |= 1 << lane;
+    }
+
+    int hitNodes[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    auto record = [&hitNodes](int mask, int node) {
+        for (; mask != 0; mask &= mask - 1)
+            hitNodes[__builtin_ctz(mask)] = node;
+    };
+
+    struct Frame {
+        int node;
+        int next;
+        int mask; // Rays that entered the node
+        glm::ivec3 lo;
+        glm::ivec3 hi;
+    };
+    Frame stack[64];
+    __m256 tNear;
+    int rootMask = EnterPacket(rays, best, 0xFF, glm::ivec3(0), glm::ivec3(octree.Size()), tNear);
+    int depth = -1;
+    if (rootMask != 0) {
+        if (nodes[0].IsLeaf) {
+            best = _mm256_blendv_ps(best, tNear, LaneMask(rootMask));
+            record(rootMask, 0);
+        } else if (octree.MaxDepth() > 0) {
+            stack[0] = {0, 0, rootMask, glm::ivec3(0), glm::ivec3(octree.Size())};
+            depth = 0;
+        }
+    }
+    while (depth >= 0 && active != 0) {
+        Frame& frame = stack[depth];
+        if (frame.next == 8 || (frame.mask & active) == 0) {
+            depth--;
+            continue;
+        }
+        int octant = frame.next++ ^ order;
+        int child = nodes[frame.node].childIndices[octant];
+        if (child == -1)
+            continue;
+        // Written out rather than calling ChildCell: a call to code built
+        // without AVX in this loop costs more than the box tests.
+        int half = halfSizes[depth];
+        glm::ivec3 lo = frame.lo;
+        glm::ivec3 hi = frame.hi;
+        for (int axis = 0; axis < 3; axis++) {
+            if (octant & (4 >> axis))
+                lo[axis] += half;
+            else
+                hi[axis] = lo[axis] + half;
+        }
+        int mask = EnterPacket(rays, best, frame.mask & active, lo, hi, tNear);
+        if (mask == 0)
+            continue;
+        if (nodes[child].IsLeaf) {
+            best = _mm256_blendv_ps(best, tNear, LaneMask(mask));
+            record(mask, child);
+            active &= ~(mask & inOrder);
+            continue;
+        }
+        if (depth + 1 == octree.MaxDepth())
+            continue; // An interior node at maxDepth is empty
+        stack[++depth] = {child, 0, mask, lo, hi};
+    }
+
+    float distances[8];
+    _mm256_storeu_ps(distances, best);
+    int hitMask = 0;
+    for (int lane = 0; lane < 8; lane++) {
+        int node = hitNodes[lane];
+        hits[lane] = {distances[lane], node, node == -1 ? 0u : octree.Colors()[node]};
+        if (node != -1)
+            hitMask |= 1 << lane;
+    }
+    return hitMask;
+}
+#endif
+
+} // namespace
+
+bool SparseVoxelOctree::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit* hit) const {
+    *hit = {maxDistance, -1, 0};
+    if (m_maxDepth >= 64)
+        return false;
+    glm::vec3 invDir = 1.0f / SafeDirection(direction);
+    int order = OctantOrder(direction);
+    auto enter = [&](glm::ivec3 lo, glm::ivec3 hi, float& tNear, float& tFar) {
+        glm::vec3 t0 = (glm::vec3(lo) - origin) * invDir;
+        glm::vec3 t1 = (glm::vec3(hi) - origin) * invDir;
+        glm::vec3 tMin = glm::min(t0, t1);
+        glm::vec3 tMax = glm::max(t0, t1);
+        tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        tFar = std::min(std::min(tMax.x, tMax.y), tMax.z);
+        return tNear <= tFar && tNear < maxDistance;
+    };
+
+    float tNear, tFar;
+    if (!enter(glm::ivec3(0), glm::ivec3(m_size), tNear, tFar))
+        return false;
+    if (m_nodes[0].IsLeaf) {
+        *hit = {tNear, 0, m_colors[0]};
+        return true;
+    }
+    if (m_maxDepth == 0)
+        return false;
+    // One frame per level. Children are walked in the order the ray passes
+    // through them: bits holds, per axis, whether the ray has crossed the
+    // node's split plane yet (in ray order, so 0 is the near half), and
+    // each step crosses the nearest plane still ahead. -1 once the ray
+    // leaves the node.
+    struct Frame {
+        int node;
+        int bits;
+        glm::ivec3 lo;
+        glm::ivec3 hi;
+        glm::vec3 tSplit;
+        float tFar;
+    };
+    Frame stack[64];
+    auto open = [&](int depth, int node, glm::ivec3 lo, glm::ivec3 hi) {
+        Frame& frame = stack[depth];
+        frame = {node, 0, lo, hi, (glm::vec3(lo + m_halfSizes[depth]) - origin) * invDir, tFar};
+        frame.bits = (frame.tSplit.x <= tNear ? 4 : 0) | (frame.tSplit.y <= tNear ? 2 : 0) |
+                     (frame.tSplit.z <= tNear ? 1 : 0);
+    };
+    open(0, 0, glm::ivec3(0), glm::ivec3(m_size));
+    int depth = 0;
+    while (depth >= 0) {
+        Frame& frame = stack[depth];
+        if (frame.bits < 0) {
+            depth--;
+            continue;
+        }
+        int octant = frame.bits ^ order;
+        // Cross the nearest plane still ahead, unless the ray leaves first.
+        float tNext = frame.tFar;
+        int cross = 0;
+        if (!(frame.bits & 4) && frame.tSplit.x <= tNext) {
+            tNext = frame.tSplit.x;
+            cross = 4;
+        }
+        if (!(frame.bits & 2) && frame.tSplit.y <= tNext) {
+            tNext = frame.tSplit.y;
+            cross = 2;
+        }
+        if (!(frame.bits & 1) && frame.tSplit.z <= tNext)
+            cross = 1;
+        frame.bits = cross != 0 ? frame.bits | cross : -1;
+
+        int child = m_nodes[frame.node].childIndices[octant];
+        if (child == -1)
+            continue;
+        glm::ivec3 lo, hi;
+        ChildCell(octant, m_halfSizes[depth], frame.lo, frame.hi, lo, hi);
+        if (!enter(lo, hi, tNear, tFar))
+            continue;
+        // Children come front to back, so the first leaf entered is the hit.
+        if (m_nodes[child].IsLeaf) {
+            *hit = {tNear, child, m_colors[child]};
+            return true;
+        }
+        if (depth + 1 == m_maxDepth)
+            continue; // An interior node at maxDepth is empty
+        open(++depth, child, lo, hi);
+    }
+    return false;
+}
+
+int SparseVoxelOctree::Raycast8(const RayPacket& packet, RayHit* hits) const {
+#ifdef OCTREE_RAYCAST_AVX2
+    if (m_maxDepth < 64 && __builtin_cpu_supports("avx2"))
+        return RaycastPacketAvx2(*this, packet, hits);
+#endif
+    int hitMask = 0;
+    for (int lane = 0; lane < 8; lane++) {
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if (Raycast(origin, direction, packet.maxDistance[lane], &hits[lane]))
+            hitMask |= 1 << lane;
+    }
+    return hitMask;
+}
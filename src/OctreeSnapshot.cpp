@@ -0,0 +1,73 @@
+#include "OctreeSnapshot.h"
+#include <algorithm>
+
+bool OctreeSnapshot::Lookup(glm::ivec3 point, glm::vec4* color) const {
+    int nodeIndex = 0;
+    glm::ivec3 position(0);
+    for (int depth = 0; depth <= m_maxDepth; depth++) {
+        const FlattenedNode& node = Node(nodeIndex);
+        if (node.IsLeaf) {
+            if (color)
+                *color = UnpackColor(Color(nodeIndex));
+            return true;
+        }
+        if (depth == m_maxDepth)
+            break;
+        nodeIndex = node.childIndices[SparseVoxelOctree::ChildOctant(point, position, m_halfSizes[depth])];
+        if (nodeIndex == -1)
+            break;
+    }
+    return false;
+}
+
+std::shared_ptr<const OctreeSnapshot> SparseVoxelOctree::Publish() {
+    std::shared_ptr<const OctreeSnapshot> previous = m_published;
+    bool changed = m_allUnpublished || !previous;
+    for (uint64_t word : m_unpublishedChunks)
+        changed = changed || word != 0;
+    if (!changed)
+        return previous;
+
+    auto snapshot = std::make_shared<OctreeSnapshot>();
+    snapshot->m_nodeCount = m_nodes.size();
+    snapshot->m_version = ++m_version;
+    snapshot->m_maxDepth = m_maxDepth;
+    snapshot->m_halfSizes = m_halfSizes;
+    size_t chunkNodes = size_t(1) << SnapshotChunkBits;
+    size_t chunkCount = (m_nodes.size() + chunkNodes - 1) >> SnapshotChunkBits;
+    snapshot->m_nodeChunks.resize(chunkCount);
+    snapshot->m_colorChunks.resize(chunkCount);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        size_t first = chunk * chunkNodes;
+        size_t count = std::min(chunkNodes, m_nodes.size() - first);
+        // A chunk that grew or shrank is copied even if its bit is clear.
+        bool dirty = m_allUnpublished || !previous || chunk >= previous->ChunkCount() ||
+                     previous->m_nodeChunks[chunk]->size() != count ||
+                     ((chunk >> 6) < m_unpublishedChunks.size() && ((m_unpublishedChunks[chunk >> 6] >> (chunk & 63)) & 1));
+        if (!dirty) {
+            snapshot->m_nodeChunks[chunk] = previous->m_nodeChunks[chunk];
+            snapshot->m_colorChunks[chunk] = previous->m_colorChunks[chunk];
+            continue;
+        }
+        auto nodes = std::make_shared<std::vector<FlattenedNode>>(count);
+        auto colors = std::make_shared<std::vector<uint32_t>>(count);
+        m_nodes.ForEachBlock(first, count, [&](const FlattenedNode* data, size_t start, size_t n) {
+            std::copy(data, data + n, nodes->begin() + (start - first));
+        });
+        m_colors.ForEachBlock(first, count, [&](const uint32_t* data, size_t start, size_t n) {
+            std::copy(data, data + n, colors->begin() + (start - first));
+        });
+        snapshot->m_nodeChunks[chunk] = std::move(nodes);
+        snapshot->m_colorChunks[chunk] = std::move(colors);
+    }
+    m_unpublishedChunks.clear();
+    m_allUnpublished = false;
+
+    std::shared_ptr<const OctreeSnapshot> published = std::move(snapshot);
+    std::atomic_store(&m_published, published);
+    return published;
+}
+
+std::shared_ptr<const OctreeSnapshot> SparseVoxelOctree::Snapshot() const {
+    return std::atomic_load(&m_published);
+}
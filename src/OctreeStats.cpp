@@ -0,0 +1,140 @@
+#include "OctreeStats.h"
+#include "Octree.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+OctreeStats SparseVoxelOctree::Stats(bool countDuplicates) const {
+    OctreeStats stats;
+    stats.size = m_size;
+    stats.maxDepth = m_maxDepth;
+    stats.merged = m_merged;
+    stats.slots = m_nodes.size();
+    stats.freeSlots = m_freeNodes.size();
+    stats.nodesPerDepth.assign(m_maxDepth + 1, 0);
+    stats.leavesPerDepth.assign(m_maxDepth + 1, 0);
+    stats.arenaBytes = m_nodes.MemoryUsage() + m_colors.MemoryUsage();
+
+    // Breadth first, so every node is counted at the depth it is first
+    // reached from; in a merged tree it may be reached at others too.
+    std::vector<bool> visited(m_nodes.size(), false);
+    std::vector<int> level(1, 0);
+    std::vector<int> next;
+    visited[0] = true;
+    size_t children = 0;
+    for (int depth = 0; !level.empty() && depth <= m_maxDepth; depth++) {
+        next.clear();
+        for (int index : level) {
+            const FlattenedNode& node = m_nodes[index];
+            stats.nodesPerDepth[depth]++;
+            int count = 0;
+            for (int child : node.childIndices) {
+                if (child == -1)
+                    continue;
+                count++;
+                if (!visited[child]) {
+                    visited[child] = true;
+                    next.push_back(child);
+                }
+            }
+            if (node.IsLeaf) {
+                stats.leaves++;
+                stats.leavesPerDepth[depth]++;
+                if (depth < m_maxDepth)
+                    stats.collapsedLeaves++;
+            } else {
+                stats.interiorNodes++;
+                children += count;
+                if (count == 0)
+                    stats.emptyInteriorNodes++;
+            }
+        }
+        level.swap(next);
+    }
+    stats.nodes = stats.leaves + stats.interiorNodes;
+    stats.unreachableSlots = stats.slots - stats.nodes - std::min(stats.freeSlots, stats.slots - stats.nodes);
+    stats.averageChildren = stats.interiorNodes ? static_cast<double>(children) / stats.interiorNodes : 0.0;
+
+    // Every slot is uploaded, reachable or not.
+    stats.topologyBytes = stats.slots * (sizeof(FlattenedNode::IsLeaf) + sizeof(FlattenedNode::childIndices));
+    stats.paddingBytes = stats.slots * sizeof(FlattenedNode) - stats.topologyBytes;
+    stats.colorBytes = stats.slots * sizeof(uint32_t);
+
+    if (countDuplicates && stats.nodes > 0) {
+        std::vector<int> representatives;
+        SubtreeIds(representatives);
+        stats.uniqueSubtrees = representatives.size();
+        stats.duplicateRatio = 1.0 - static_cast<double>(stats.uniqueSubtrees) / stats.nodes;
+    }
+    return stats;
+}
+
+void OctreeStats::Print(std::ostream& out) const {
+    char line[160];
+    auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+    std::snprintf(line, sizeof(line), "Octree: size %d, depth %d%s, %zu nodes in %zu slots (%zu free, %zu unreachable)",
+                  size, maxDepth, merged ? ", merged" : "", nodes, slots, freeSlots, unreachableSlots);
+    out << line << std::endl;
+    std::snprintf(line, sizeof(line), "  leaves %zu (%.1f%%, %zu collapsed), interior %zu (%.1f%%, %zu empty), %.2f children per interior node",
+                  leaves, nodes ? 100.0 * leaves / nodes : 0.0, collapsedLeaves, interiorNodes,
+                  nodes ? 100.0 * interiorNodes / nodes : 0.0, emptyInteriorNodes, averageChildren);
+    out << line << std::endl;
+    std::snprintf(line, sizeof(line), "  %5s %10s %10s", "depth", "nodes", "leaves");
+    out << line << std::endl;
+    for (size_t depth = 0; depth < nodesPerDepth.size(); depth++) {
+        std::snprintf(line, sizeof(line), "  %5zu %10zu %10zu", depth, nodesPerDepth[depth], leavesPerDepth[depth]);
+        out << line << std::endl;
+    }
+    std::snprintf(line, sizeof(line), "  GPU %.2f MB: topology %.2f MB, color %.2f MB, padding %.2f MB; arenas hold %.2f MB",
+                  megabytes(GpuBytes()), megabytes(topologyBytes), megabytes(colorBytes), megabytes(paddingBytes),
+                  megabytes(arenaBytes));
+    out << line << std::endl;
+    if (uniqueSubtrees) {
+        std::snprintf(line, sizeof(line), "  %zu distinct subtrees, %.1f%% of nodes are duplicates",
+                      uniqueSubtrees, 100.0 * duplicateRatio);
+        out << line << std::endl;
+    }
+    for (const BuildPhase& phase : phases) {
+        std::snprintf(line, sizeof(line), "  %-16s %10.1f ms", phase.name.c_str(), phase.milliseconds);
+        out << line << std::endl;
+    }
+}
+
+std::string OctreeStats::ToJson() const {
+    std::ostringstream json;
+    auto list = [&](const std::vector<size_t>& values) {
+        json << "[";
+        for (size_t i = 0; i < values.size(); i++)
+            json << (i ? ", " : "") << values[i];
+        json << "]";
+    };
+    json << "{\n";
+    json << "  \"size\": " << size << ",\n";
+    json << "  \"maxDepth\": " << maxDepth << ",\n";
+    json << "  \"merged\": " << (merged ? "true" : "false") << ",\n";
+    json << "  \"slots\": " << slots << ",\n";
+    json << "  \"freeSlots\": " << freeSlots << ",\n";
+    json << "  \"unreachableSlots\": " << unreachableSlots << ",\n";
+    json << "  \"nodes\": " << nodes << ",\n";
+    json << "  \"leaves\": " << leaves << ",\n";
+    json << "  \"interiorNodes\": " << interiorNodes << ",\n";
+    json << "  \"emptyInteriorNodes\": " << emptyInteriorNodes << ",\n";
+    json << "  \"collapsedLeaves\": " << collapsedLeaves << ",\n";
+    json << "  \"nodesPerDepth\": ";
+    list(nodesPerDepth);
+    json << ",\n  \"leavesPerDepth\": ";
+    list(leavesPerDepth);
+    json << ",\n";
+    json << "  \"averageChildren\": " << averageChildren << ",\n";
+    json << "  \"bytes\": {\"topology\": " << topologyBytes << ", \"color\": " << colorBytes
+         << ", \"padding\": " << paddingBytes << ", \"gpu\": " << GpuBytes() << ", \"arena\": " << arenaBytes << "},\n";
+    json << "  \"uniqueSubtrees\": " << uniqueSubtrees << ",\n";
+    json << "  \"duplicateRatio\": " << duplicateRatio << ",\n";
+    json << "  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++) {
+        // Phase names are fixed strings from the caller; nothing to escape.
+        json << (i ? ", " : "") << "{\"name\": \"" << phases[i].name << "\", \"milliseconds\": " << phases[i].milliseconds << "}";
+    }
+    json << "]\n}\n";
+    return json.str();
+}
@@ -0,0 +1,115 @@
+#include "OctreeUploader.h"
+#include <algorithm>
+#include <cstring>
+
+OctreeUploader::OctreeUploader() {
+    glGenBuffers(1, &m_nodeBuffer);
+    glGenBuffers(1, &m_colorBuffer);
+}
+
+OctreeUploader::~OctreeUploader() {
+    glDeleteBuffers(1, &m_nodeBuffer);
+    glDeleteBuffers(1, &m_colorBuffer);
+}
+
+size_t OctreeUploader::Upload(SparseVoxelOctree& octree) {
+    // The live tree's dirty ranges say nothing about what a snapshot upload
+    // left in the buffers, so the next snapshot starts from scratch.
+    m_lastSnapshot.reset();
+    std::vector<SparseVoxelOctree::NodeRange> ranges = octree.TakeDirtyRanges();
+    size_t count = octree.Nodes().size();
+    if (count > m_capacity) {
+        // Reallocating drops the old contents, so everything goes up again.
+        m_capacity = count + count / 4 + 1024;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_nodeBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(FlattenedNode), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_colorBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+        ranges.assign(1, {0, count});
+    }
+    size_t bytes = 0;
+    for (const SparseVoxelOctree::NodeRange& range : ranges)
+        bytes += UploadRange(octree, range.first, range.count);
+    return bytes;
+}
+
+size_t OctreeUploader::Upload(const std::shared_ptr<const OctreeSnapshot>& snapshot) {
+    if (!snapshot || snapshot == m_lastSnapshot)
+        return 0;
+    size_t count = snapshot->NodeCount();
+    std::shared_ptr<const OctreeSnapshot> last = m_lastSnapshot;
+    if (count > m_capacity) {
+        m_capacity = count + count / 4 + 1024;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_nodeBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(FlattenedNode), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_colorBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+        last.reset();
+    }
+    size_t bytes = 0;
+    size_t chunkNodes = size_t(1) << OctreeSnapshot::ChunkBits;
+    size_t pageNodes = size_t(1) << SparseVoxelOctree::DirtyPageBits;
+    for (size_t chunk = 0; chunk < snapshot->ChunkCount(); chunk++) {
+        const std::vector<FlattenedNode>& nodes = *snapshot->NodeChunkAt(chunk);
+        const std::vector<uint32_t>& colors = *snapshot->ColorChunkAt(chunk);
+        const std::vector<FlattenedNode>* lastNodes = nullptr;
+        const std::vector<uint32_t>* lastColors = nullptr;
+        if (last && chunk < last->ChunkCount()) {
+            // Shared chunks are already in the buffers.
+            if (last->NodeChunkAt(chunk) == snapshot->NodeChunkAt(chunk) &&
+                last->ColorChunkAt(chunk) == snapshot->ColorChunkAt(chunk))
+                continue;
+            lastNodes = last->NodeChunkAt(chunk).get();
+            lastColors = last->ColorChunkAt(chunk).get();
+        }
+        // A copied chunk mostly holds what was sent before, so it goes up
+        // in runs of the pages that differ from the last snapshot's copy,
+        // like the live tree's dirty ranges.
+        auto pageChanged = [&](size_t first) {
+            if (!lastNodes || first >= lastNodes->size())
+                return true;
+            size_t end = std::min(first + pageNodes, nodes.size());
+            if (end > lastNodes->size())
+                return true;
+            return std::memcmp(&nodes[first], &(*lastNodes)[first], (end - first) * sizeof(FlattenedNode)) != 0 ||
+                   std::memcmp(&colors[first], &(*lastColors)[first], (end - first) * sizeof(uint32_t)) != 0;
+        };
+        for (size_t first = 0; first < nodes.size();) {
+            if (!pageChanged(first)) {
+                first += pageNodes;
+                continue;
+            }
+            size_t end = first + pageNodes;
+            while (end < nodes.size() && pageChanged(end))
+                end += pageNodes;
+            end = std::min(end, nodes.size());
+            size_t offset = chunk * chunkNodes + first;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_nodeBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset * sizeof(FlattenedNode),
+                            (end - first) * sizeof(FlattenedNode), &nodes[first]);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_colorBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset * sizeof(uint32_t), (end - first) * sizeof(uint32_t),
+                            &colors[first]);
+            bytes += (end - first) * (sizeof(FlattenedNode) + sizeof(uint32_t));
+            first = end;
+        }
+    }
+    m_lastSnapshot = snapshot;
+    return bytes;
+}
+
+size_t OctreeUploader::UploadRange(const SparseVoxelOctree& octree, size_t first, size_t count) {
+    // The arenas are stored in blocks, so a range may arrive in pieces.
+    size_t bytes = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_nodeBuffer);
+    octree.Nodes().ForEachBlock(first, count, [&](const FlattenedNode* data, size_t start, size_t n) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, start * sizeof(FlattenedNode), n * sizeof(FlattenedNode), data);
+        bytes += n * sizeof(FlattenedNode);
+    });
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_colorBuffer);
+    octree.Colors().ForEachBlock(first, count, [&](const uint32_t* data, size_t start, size_t n) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, start * sizeof(uint32_t), n * sizeof(uint32_t), data);
+        bytes += n * sizeof(uint32_t);
+    });
+    return bytes;
+}
@@ -0,0 +1,233 @@
+#include "Terrain.h"
+#include "Parallel.h"
+#include <glm/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TERRAIN_NOISE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The batch kernel below only knows plain fBm.
+static_assert(TerrainNoise::Params.shape == NoiseShape::Fbm && TerrainNoise::Params.warpAmplitude == 0.0f,
+              "YsAvx2 doesn't shape or warp its octaves");
+
+#ifdef TERRAIN_NOISE_AVX2
+__attribute__((target("avx2"))) inline __m256 Fade8(__m256 t) {
+    // t * t * t * (t * (t * 6 - 15) + 10), multiplied in the same order
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)),
+                                                                _mm256_set1_ps(15.0f))),
+                                 _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+__attribute__((target("avx2"))) inline __m256 Lerp8(__m256 a, __m256 b, __m256 t) {
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// grad without branches: every choice becomes a compare and a blend.
+__attribute__((target("avx2"))) inline __m256 Grad8(__m256i hash, __m256 x, __m256 z) {
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+    __m256 below8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+    __m256 below4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    __m256 is12or14 = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+                                                          _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+    __m256 u = _mm256_blendv_ps(z, x, below8);
+    __m256 v = _mm256_blendv_ps(_mm256_and_ps(x, is12or14), z, below4);
+    // Bits 0 and 1 flip the signs of u and v.
+    __m256 signU = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+    __m256 signV = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31));
+    return _mm256_add_ps(_mm256_xor_ps(u, signU), _mm256_xor_ps(v, signV));
+}
+
+__attribute__((target("avx2"))) inline __m256 Noise8(const int* perm, __m256 x, __m256 z) {
+    __m256 floorX = _mm256_floor_ps(x);
+    __m256 floorZ = _mm256_floor_ps(z);
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i X = _mm256_and_si256(_mm256_cvttps_epi32(floorX), mask);
+    __m256i Z = _mm256_and_si256(_mm256_cvttps_epi32(floorZ), mask);
+    x = _mm256_sub_ps(x, floorX);
+    z = _mm256_sub_ps(z, floorZ);
+
+    __m256 u = Fade8(x);
+    __m256 v = Fade8(z);
+
+    __m256i A = _mm256_add_epi32(_mm256_i32gather_epi32(perm, X, 4), Z);
+    __m256i AA = _mm256_i32gather_epi32(perm, A, 4);
+    __m256i AB = _mm256_i32gather_epi32(perm, _mm256_add_epi32(A, one), 4);
+    __m256i B = _mm256_add_epi32(_mm256_i32gather_epi32(perm, _mm256_add_epi32(X, one), 4), Z);
+    __m256i BA = _mm256_i32gather_epi32(perm, B, 4);
+    __m256i BB = _mm256_i32gather_epi32(perm, _mm256_add_epi32(B, one), 4);
+
+    __m256 oneF = _mm256_set1_ps(1.0f);
+    __m256 x1 = _mm256_sub_ps(x, oneF);
+    __m256 z1 = _mm256_sub_ps(z, oneF);
+    return Lerp8(Lerp8(Grad8(AA, x, z), Grad8(BA, x1, z), u),
+                 Lerp8(Grad8(AB, x, z1), Grad8(BB, x1, z1), u),
+                 v);
+}
+
+__attribute__((target("avx2"))) void HeightsAvx2(const int* perm, const float* x, const float* z, float* out, size_t count) {
+    for (size_t i = 0; i < count; i += 8)
+        _mm256_storeu_ps(out + i, Noise8(perm, _mm256_loadu_ps(x + i), _mm256_loadu_ps(z + i)));
+}
+
+__attribute__((target("avx2"))) void YsAvx2(const int* perm, const float* x, const float* z, float* out, size_t count,
+                                            float scale) {
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 sampleX = _mm256_loadu_ps(x + i);
+        __m256 sampleZ = _mm256_loadu_ps(z + i);
+        __m256 total = _mm256_setzero_ps();
+        for (int octave = 0; octave < TerrainNoise::Params.octaves; octave++) {
+            __m256 f = _mm256_set1_ps(TerrainNoise::Params.Frequency(octave));
+            __m256 noise = Noise8(perm, _mm256_mul_ps(sampleX, f), _mm256_mul_ps(sampleZ, f));
+            total = _mm256_add_ps(total, _mm256_mul_ps(noise, _mm256_set1_ps(TerrainNoise::Params.Amplitude(octave))));
+        }
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(total, _mm256_set1_ps(scale)));
+    }
+}
+
+bool HasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+} // namespace
+
+glm::vec4 getMountainColor(float noiseHeight, const std::vector<ColorStop>& stops) {
+    // If no stops are provided, return white as a fallback.
+    if (stops.empty())
+        return glm::vec4(1.0f);
+
+    // If below the first stop, return the first color.
+    if (noiseHeight <= stops.front().height)
+        return stops.front().color;
+    
+    // If above the last stop, return the last color.
+    if (noiseHeight >= stops.back().height)
+        return stops.back().color;
+    
+    // Find the two stops noiseHeight lies between.
+    for (size_t i = 0; i < stops.size() - 1; i++) {
+        if (noiseHeight < stops[i + 1].height) {
+            float t = (noiseHeight - stops[i].height) / (stops[i + 1].height - stops[i].height);
+            return glm::mix(stops[i].color, stops[i + 1].color, t);
+        }
+    }
+    
+    return stops.back().color; // Fallback (should not be reached)
+}
+
+void TerrainGenerator::initPermutation() {
+    std::vector<int> p(256);
+    std::iota(p.begin(), p.end(), 0);
+    std::shuffle(p.begin(), p.end(), std::mt19937(seed));
+
+    perm.resize(512);
+    for(int i = 0; i < 512; i++)
+        perm[i] = p[i & 255];
+}
+
+float TerrainGenerator::getNoise(const NoiseStack& stack, float x, float z) const {
+    if (stack.warpAmplitude != 0.0f)
+        warp(stack.warpAmplitude, stack.warpFrequency, x, z);
+    float amplitude = stack.amplitude;
+    float frequency = stack.frequency;
+    float total = 0.0f;
+    for (int i = 0; i < stack.octaves; i++) {
+        total += shapeOctave(stack.shape, getHeight(x * frequency, z * frequency)) * amplitude;
+        amplitude *= stack.persistence;
+        frequency *= stack.lacunarity;
+    }
+    return total;
+}
+
+float TerrainGenerator::getNoise(const NoiseStack& stack, float x, float y, float z) const {
+    if (stack.warpAmplitude != 0.0f)
+        warp(stack.warpAmplitude, stack.warpFrequency, x, z);
+    float amplitude = stack.amplitude;
+    float frequency = stack.frequency;
+    float total = 0.0f;
+    for (int i = 0; i < stack.octaves; i++) {
+        total += shapeOctave(stack.shape, getNoise3(x * frequency, y * frequency, z * frequency)) * amplitude;
+        amplitude *= stack.persistence;
+        frequency *= stack.lacunarity;
+    }
+    return total;
+}
+
+float TerrainGenerator::getY(float x, float z, float scale) const {
+    return getNoise<TerrainNoise>(x, z) * scale;
+}
+
+void TerrainGenerator::getHeights(const float* x, const float* z, float* out, size_t count) const {
+    size_t done = 0;
+#ifdef TERRAIN_NOISE_AVX2
+    if (HasAvx2()) {
+        done = count - count % BatchWidth;
+        HeightsAvx2(perm.data(), x, z, out, done);
+    }
+#endif
+    for (size_t i = done; i < count; i++)
+        out[i] = getHeight(x[i], z[i]);
+}
+
+void TerrainGenerator::getYs(const float* x, const float* z, float* out, size_t count, float scale) const {
+    size_t done = 0;
+#ifdef TERRAIN_NOISE_AVX2
+    if (HasAvx2()) {
+        done = count - count % BatchWidth;
+        YsAvx2(perm.data(), x, z, out, done, scale);
+    }
+#endif
+    for (size_t i = done; i < count; i++)
+        out[i] = getY(x[i], z[i], scale);
+}
+
+void Heightfield::Generate(const TerrainGenerator& terrain, int samples, float spacing, const std::vector<ColorStop>& stops,
+                           int threadCount, int tileSize) {
+    m_samples = std::max(samples, 0);
+    m_spacing = spacing;
+    m_heights.assign(static_cast<size_t>(m_samples) * m_samples, 0.0f);
+    m_colors.assign(m_heights.size(), 0);
+    tileSize = std::max(tileSize, 1);
+    int tilesPerAxis = (m_samples + tileSize - 1) / tileSize;
+    ParallelFor(static_cast<size_t>(tilesPerAxis) * tilesPerAxis, threadCount, [&](size_t tile) {
+        int x0 = static_cast<int>(tile / tilesPerAxis) * tileSize;
+        int z0 = static_cast<int>(tile % tilesPerAxis) * tileSize;
+        int width = std::min(tileSize, m_samples - z0);
+        std::vector<float> rowX(width);
+        std::vector<float> rowZ(width);
+        for (int i = 0; i < width; i++)
+            rowZ[i] = (z0 + i) * spacing;
+        for (int ix = x0; ix < std::min(x0 + tileSize, m_samples); ix++) {
+            std::fill(rowX.begin(), rowX.end(), ix * spacing);
+            float* heights = &m_heights[Index(ix, z0)];
+            terrain.getYs(rowX.data(), rowZ.data(), heights, width);
+            for (int i = 0; i < width; i++)
+                m_colors[Index(ix, z0 + i)] = glm::packUnorm4x8(getMountainColor(heights[i], stops));
+        }
+    });
+}
+
+float Heightfield::HeightAt(float x, float z) const {
+    if (m_samples < 2)
+        return m_samples ? m_heights[0] : 0.0f;
+    float limit = static_cast<float>(m_samples - 1);
+    float fx = glm::clamp(x / m_spacing, 0.0f, limit);
+    float fz = glm::clamp(z / m_spacing, 0.0f, limit);
+    int ix = std::min(static_cast<int>(fx), m_samples - 2);
+    int iz = std::min(static_cast<int>(fz), m_samples - 2);
+    float tx = fx - ix;
+    float tz = fz - iz;
+    float near = glm::mix(Height(ix, iz), Height(ix, iz + 1), tz);
+    float far = glm::mix(Height(ix + 1, iz), Height(ix + 1, iz + 1), tz);
+    return glm::mix(near, far, tx);
+}
@@ -3,14 +3,36 @@
 #include <iostream>
 #include <shader/Shader.h>
 #include <shader/Compute.h>
+#include <Octree.h>
+#include <CompactOctree.h>
+#include <Parallel.h>
+#include <Benchmark.h>
+#include <DensityField.h>
+#include <OctreeUploader.h>
+#include <OctreeFile.h>
+#include <ChunkedWorldFile.h>
+#include <OctreeStats.h>
+#include <Terrain.h>
+#include <CsgShape.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <string>
 #include <vector>
 #include <cmath>
-#include <numeric>
 #include <algorithm>
-#include <random>
+
+// Set by CMake to the source tree's shader directory; the fallback works when
+// run from the repository root.
+#ifndef SHADER_DIR
+#define SHADER_DIR "src/shader/"
+#endif
+
 // A dedicated terrain noise function using basic sine/cosine waves.
 float generateTerrainNoise(float x, float z) {
     // Adjust these constants to control the terrain frequency and amplitude.
@@ -42,181 +64,233 @@ float fov   = 45.0f;
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
-class TerrainGenerator {
-    private:
-        std::vector<int> perm;
-        int seed;
-    
-        void initPermutation() {
-            std::vector<int> p(256);
-            std::iota(p.begin(), p.end(), 0);
-            std::shuffle(p.begin(), p.end(), std::mt19937(seed));
-            
-            perm.resize(512);
-            for(int i = 0; i < 512; i++)
-                perm[i] = p[i & 255];
-        }
-    
-        float fade(float t) const {
-            return t * t * t * (t * (t * 6 - 15) + 10);
-        }
-    
-        float lerp(float a, float b, float t) const {
-            return a + t * (b - a);
-        }
-    
-        float grad(int hash, float x, float z) const {
-            int h = hash & 15;
-            float u = h < 8 ? x : z;
-            float v = h < 4 ? z : h == 12 || h == 14 ? x : 0;
-            return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
-        }
-    
-    public:
-        TerrainGenerator(int seed = 0) : seed(seed) {
-            initPermutation();
-        }
-    
-        float getHeight(float x, float z) const {
-            int X = (int)floor(x) & 255;
-            int Z = (int)floor(z) & 255;
-            x -= floor(x);
-            z -= floor(z);
-    
-            float u = fade(x);
-            float v = fade(z);
-    
-            int A = perm[X] + Z;
-            int AA = perm[A];
-            int AB = perm[A + 1];
-            int B = perm[X + 1] + Z;
-            int BA = perm[B];
-            int BB = perm[B + 1];
-    
-            return lerp(lerp(grad(AA, x,   z),
-                           grad(BA, x-1, z),
-                           u),
-                    lerp(grad(AB, x,   z-1),
-                           grad(BB, x-1, z-1),
-                           u),
-                    v);
-        }
-    
-        // Example scaling function to convert noise to terrain height
-        float getY(float x, float z, float scale = 60.0f) const {
-            float amplitude = 2.5f;
-            float frequency = 0.005f;
-            float persistence = 0.4f;
-            float lacunarity = 1.0f;
-            float total = 0.0f;
-            
-            // Add multiple octaves for more detail
-            for(int i = 0; i < 6; i++) {
-                total += getHeight(x * frequency, z * frequency) * amplitude;
-                amplitude *= persistence;
-                frequency *= lacunarity;
-            }
-            
-            return total * scale;
-        }
-    };
-  // Structure representing a color stop.
-struct ColorStop {
-    float height;      // The elevation at which this color applies.
-    glm::vec4 color;   // The color at this height.
-};
 std::vector<ColorStop> mountainStops = {
     { 50.0f, glm::vec4(0.1f, 0.3f, 0.1f, 1.0f) }, // Lower altitudes: lush green
     { 100.0f, glm::vec4(0.1f, 0.2f, 0.1f, 1.0f) }, // Transition: gray for rocky areas
     { 200.0f, glm::vec4(0.6f, 0.6f, 0.6f, 1.0f) }, // Higher altitudes: light gray
     { 300.0f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f) }  // Peaks: snow white
 };
-// Given a noiseHeight and a sorted array of color stops, returns the interpolated color.
-glm::vec4 getMountainColor(float noiseHeight, const std::vector<ColorStop>& stops) {
-    // If no stops are provided, return white as a fallback.
-    if (stops.empty())
-        return glm::vec4(1.0f);
-
-    // If below the first stop, return the first color.
-    if (noiseHeight <= stops.front().height)
-        return stops.front().color;
-    
-    // If above the last stop, return the last color.
-    if (noiseHeight >= stops.back().height)
-        return stops.back().color;
-    
-    // Find the two stops noiseHeight lies between.
-    for (size_t i = 0; i < stops.size() - 1; i++) {
-        if (noiseHeight < stops[i + 1].height) {
-            float t = (noiseHeight - stops[i].height) / (stops[i + 1].height - stops[i].height);
-            return glm::mix(stops[i].color, stops[i + 1].color, t);
+int main(int argc, char** argv) {
+    // --layout-benchmark compares node layouts on the generated terrain and
+    // exits; --layout bfs|dfs|veb picks the node order uploaded to the GPU.
+    // --check-concurrent runs the concurrent insert stress test and exits.
+    // --check-snapshots edits the terrain while readers hold published
+    // snapshots, checks them against the live tree and exits.
+    // --query-benchmark times the CPU octree queries and exits.
+    // --raycast-benchmark times the CPU ray traversals and exits.
+    // --brick-benchmark compares the brick octree with the flat one and exits.
+    // --noise-benchmark times the terrain noise stacks and exits.
+    // --merge shares identical subtrees after generating; the world can't
+    // be edited afterwards.
+    // --caves generates 3D terrain with overhangs and caves.
+    // --world <path> loads the octree from path instead of generating it, or
+    // generates it and saves it there if the file is missing or stale.
+    // --chunked-world <path> does the same with a chunked, compressed file.
+    // --stats-json <path> writes the startup octree report there as JSON.
+    bool layoutBenchmark = false;
+    bool queryBenchmark = false;
+    bool raycastBenchmark = false;
+    bool brickBenchmark = false;
+    bool noiseBenchmark = false;
+    bool caves = false;
+    bool mergeSubtrees = false;
+    bool concurrentCheck = false;
+    bool snapshotCheck = false;
+    NodeLayout layout = NodeLayout::BreadthFirst;
+    std::string worldPath;
+    std::string chunkedWorldPath;
+    std::string statsPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--layout-benchmark") {
+            layoutBenchmark = true;
+        } else if (arg == "--query-benchmark") {
+            queryBenchmark = true;
+        } else if (arg == "--raycast-benchmark") {
+            raycastBenchmark = true;
+        } else if (arg == "--brick-benchmark") {
+            brickBenchmark = true;
+        } else if (arg == "--noise-benchmark") {
+            noiseBenchmark = true;
+        } else if (arg == "--merge") {
+            mergeSubtrees = true;
+        } else if (arg == "--caves") {
+            caves = true;
+        } else if (arg == "--check-concurrent") {
+            concurrentCheck = true;
+        } else if (arg == "--check-snapshots") {
+            snapshotCheck = true;
+        } else if (arg == "--world" && i + 1 < argc) {
+            worldPath = argv[++i];
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (arg == "--chunked-world" && i + 1 < argc) {
+            chunkedWorldPath = argv[++i];
+        } else if (arg == "--layout" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "dfs")
+                layout = NodeLayout::DepthFirst;
+            else if (name == "veb")
+                layout = NodeLayout::VanEmdeBoas;
+            else if (name != "bfs")
+                std::cout << "Unknown layout " << name << ", using bfs" << std::endl;
+        } else {
+            std::cout << "Unknown argument " << arg << std::endl;
         }
     }
-    
-    return stops.back().color; // Fallback (should not be reached)
+
+const uint32_t terrainSeed = 20;
+TerrainGenerator terrainGen(terrainSeed);
+// A 3D noise stack carves up to about 36 units around the surface.
+const NoiseStack caveNoise{NoiseShape::Fbm, 2, 12.0f, 0.015f, 0.5f, 2.0f};
+// Saved worlds record what generated them, so changing the noise or
+// toggling --caves regenerates them instead of loading a stale world.
+uint32_t generator = TerrainNoise::Params.Hash();
+if (caves)
+    generator = caveNoise.Hash(generator ^ 1u);
+if (noiseBenchmark) {
+    RunNoiseBenchmark(terrainGen);
+    return 0;
 }
-struct FlattenedNode {
-    bool IsLeaf = false;
-    char padding1[3];       // Pad bool to 4 bytes
-    int childIndices[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
-    char padding2[12];      // Pad to align vec4 to 16 bytes after the array
-    glm::vec4 color = glm::vec4(1.0f); // default white
-};
+// Setup octree for terrain.
+    int octreeSize = 1550;  // The world spans from 0 to 100 along x and z.
+    int maxDepth = 9;      // Adjust as needed; note that higher depths yield smaller voxels.
+    SparseVoxelOctree octree(octreeSize, maxDepth);
 
-std::vector<FlattenedNode> m_nodes;
+// Compute the current voxel size.
+float voxelSize = static_cast<float>(octreeSize) / std::exp2(maxDepth);
 
-class SparseVoxelOctree {
-public:
-    SparseVoxelOctree(int size, int maxDepth);
-    void Insert(glm::vec3 point, glm::vec4 color);
-private:
-    void InsertImpl(int nodeIndex, glm::ivec3 point, glm::vec4 color, glm::ivec3 position, int depth);
-    int m_size;
-    int m_maxDepth;
+// Times each step of getting the world ready for the startup report.
+std::vector<BuildPhase> phases;
+auto phaseStart = std::chrono::steady_clock::now();
+auto endPhase = [&](const char* name) {
+    auto now = std::chrono::steady_clock::now();
+    phases.push_back({name, std::chrono::duration<double, std::milli>(now - phaseStart).count()});
+    phaseStart = now;
 };
 
-SparseVoxelOctree::SparseVoxelOctree(int size, int maxDepth)
-    : m_size(size), m_maxDepth(maxDepth) {
-    m_nodes.push_back(FlattenedNode()); // root node
+// A saved world made with the same settings replaces the whole generation
+// step. The concurrent check needs the voxels, so it always generates.
+bool loaded = false;
+if (!worldPath.empty() && !concurrentCheck) {
+    OctreeFile world;
+    if (world.Open(worldPath)) {
+        if (world.Matches(octreeSize, maxDepth, terrainSeed, generator))
+            loaded = octree.Load(world);
+        else
+            std::cout << worldPath << " was made with other settings, regenerating" << std::endl;
+    }
+} else if (!chunkedWorldPath.empty() && !concurrentCheck) {
+    ChunkedWorldFile world;
+    if (world.Open(chunkedWorldPath)) {
+        if (world.Matches(octreeSize, maxDepth, terrainSeed, generator))
+            loaded = octree.Load(world, DefaultThreadCount());
+        else
+            std::cout << chunkedWorldPath << " was made with other settings, regenerating" << std::endl;
+    }
 }
+if (loaded)
+    endPhase("load");
 
-void SparseVoxelOctree::Insert(glm::vec3 point, glm::vec4 color) {
-    InsertImpl(0, glm::ivec3(point), color, glm::ivec3(0), 0);
-}
+if (!loaded) {
+    // Generate terrain: for each (x, z) coordinate, compute a terrain height using noise,
+    // then fill the column from y = 0 up to that height, stepping in increments of voxelSize.
+    // Compute how many voxels we have along one axis
+int voxelsPerAxis = static_cast<int>(octreeSize / voxelSize);
 
-void SparseVoxelOctree::InsertImpl(int nodeIndex, glm::ivec3 point, glm::vec4 color, glm::ivec3 position, int depth) {
-    if (nodeIndex >= m_nodes.size()) {
-        std::cout << "Index out of bounds" << std::endl;
-        return;
-    }
-    FlattenedNode &node = m_nodes[nodeIndex];
-    node.color = color;
-    if (depth == m_maxDepth) {
-        node.IsLeaf = true;
-        return;
-    }
-    float size = m_size / std::exp2(depth);
-    glm::ivec3 center = position + glm::ivec3(size / 2.0f);
-    glm::ivec3 childPos = {
-        (point.x >= center.x) ? 1 : 0,
-        (point.y >= center.y) ? 1 : 0,
-        (point.z >= center.z) ? 1 : 0
-    };
-    int childIndex = (childPos.x << 2) | (childPos.y << 1) | (childPos.z);
-    if (node.childIndices[childIndex] == -1) {
-        node.childIndices[childIndex] = m_nodes.size();
-        m_nodes.push_back(FlattenedNode());
+// The surface comes from a heightfield filled in parallel, tile by tile.
+Heightfield heightfield;
+heightfield.Generate(terrainGen, voxelsPerAxis, voxelSize, mountainStops, DefaultThreadCount());
+endPhase("heightfield");
+
+// Each column holds the top four voxels under its height.
+float depthBelow = 3.0f;
+if (concurrentCheck) {
+    // The stress test inserts the same surface voxel by voxel.
+    std::vector<Voxel> voxels;
+    voxels.reserve(static_cast<size_t>(voxelsPerAxis) * voxelsPerAxis * 4);
+    for (int ix = 0; ix < voxelsPerAxis; ix++) {
+        for (int iz = 0; iz < voxelsPerAxis; iz++) {
+            glm::vec4 color = UnpackColor(heightfield.Color(ix, iz));
+            for (int i = 0; i <= depthBelow; i++)
+                voxels.push_back({ glm::vec3(ix * voxelSize, heightfield.Height(ix, iz) - i, iz * voxelSize), color });
+        }
     }
-    glm::ivec3 newPosition = position + childPos * glm::ivec3(size / 2);
-    InsertImpl(node.childIndices[childIndex], point, color, newPosition, depth + 1);
+    return RunConcurrentInsertCheck(voxels, octreeSize, maxDepth, DefaultThreadCount()) ? 0 : 1;
+}
+if (caves) {
+    DensityField density(terrainGen, heightfield, caveNoise, voxelsPerAxis);
+    std::vector<Voxel> voxels;
+    DensityStats densityStats = density.Generate(voxels, DefaultThreadCount());
+    endPhase("density");
+    std::cout << "Density chunks: " << densityStats.airChunks << " air, " << densityStats.solidChunks << " solid, "
+              << densityStats.mixedChunks << " mixed; " << densityStats.noiseSamples << " noise samples, "
+              << densityStats.voxels << " voxels" << std::endl;
+    octree.Build(voxels, DefaultThreadCount());
+} else {
+    // Straight from the heightfield: the same tree Build makes from those
+    // voxels, without listing or sorting them.
+    octree.BuildFromHeightfield(heightfield, depthBelow);
+}
+endPhase("build");
+// Give interior nodes the filtered color of what's below them, which is
+// what the shader shows when it stops at a coarse node for distant pixels.
+octree.FilterColors(ColorFilter::CoverageWeighted, DefaultThreadCount());
+endPhase("filter colors");
+
+// Share identical subtrees (sparse voxel DAG). The node format is unchanged,
+// so the shader doesn't care, but the tree can't be edited afterwards.
+if (mergeSubtrees) {
+    size_t removed = octree.MergeIdenticalSubtrees();
+    std::cout << "Merged " << removed << " duplicate nodes, " << octree.Nodes().size() << " left" << std::endl;
+    endPhase("merge");
+}
+if (!worldPath.empty())
+    OctreeFile::Save(octree, worldPath, terrainSeed, generator);
+else if (!chunkedWorldPath.empty())
+    ChunkedWorldFile::Save(octree, chunkedWorldPath, terrainSeed, generator, ChunkedWorldFile::DefaultChunkDepth, DefaultThreadCount());
+if (!worldPath.empty() || !chunkedWorldPath.empty())
+    endPhase("save");
+}
+
+if (layoutBenchmark) {
+    RunLayoutBenchmark(octree);
+    return 0;
+}
+if (queryBenchmark) {
+    RunQueryBenchmark(octree);
+    return 0;
+}
+if (brickBenchmark) {
+    RunBrickBenchmark(octree);
+    return 0;
+}
+if (raycastBenchmark) {
+    RunRaycastBenchmark(octree);
+    return 0;
+}
+if (snapshotCheck)
+    return RunSnapshotCheck(octree, DefaultThreadCount()) ? 0 : 1;
+// Build emits breadth-first order already.
+if (layout != NodeLayout::BreadthFirst) {
+    octree.Reorder(layout);
+    endPhase("reorder");
+}
+
+OctreeStats stats = octree.Stats();
+stats.phases = phases;
+stats.Print(std::cout);
+if (!statsPath.empty()) {
+    std::ofstream statsFile(statsPath);
+    statsFile << stats.ToJson();
+    if (!statsFile)
+        std::cout << "Could not write " << statsPath << std::endl;
 }
 
-int main() {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-TerrainGenerator terrainGen(20);
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Terrain Generation", NULL, NULL);
     if (window == nullptr) {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -231,8 +305,12 @@ TerrainGenerator terrainGen(20);
         return -1;
     }
 
-    Shader ourShader("/home/erectus/Documents/Octree/src/shader/vert.glsl", "/home/erectus/Documents/Octree/src/shader/frag.glsl");
-    ComputeShader computeShader("/home/erectus/Documents/Octree/src/shader/compute.glsl");
+    Shader ourShader(SHADER_DIR "vert.glsl", SHADER_DIR "frag.glsl");
+#ifdef OCTREE_COMPACT_NODES
+    ComputeShader computeShader(SHADER_DIR "compute.glsl", {"COMPACT_NODES"});
+#else
+    ComputeShader computeShader(SHADER_DIR "compute.glsl");
+#endif
 
     float quadVertices[] = {
         -1.0f,  1.0f,
@@ -243,51 +321,6 @@ TerrainGenerator terrainGen(20);
          1.0f,  1.0f
     };
 
-// Setup octree for terrain.
-    int octreeSize = 1550;  // The world spans from 0 to 100 along x and z.
-    int maxDepth = 9;      // Adjust as needed; note that higher depths yield smaller voxels.
-    SparseVoxelOctree octree(octreeSize, maxDepth);
-    m_nodes.reserve(50000000); // Pre-reserve enough memory to reduce reallocations.
-
-// Compute the current voxel size.
-float voxelSize = static_cast<float>(octreeSize) / std::exp2(maxDepth);
-
-    // Generate terrain: for each (x, z) coordinate, compute a terrain height using noise,
-    // then fill the column from y = 0 up to that height, stepping in increments of voxelSize.
-    // Compute how many voxels we have along one axis
-int voxelsPerAxis = static_cast<int>(octreeSize / voxelSize);
-
-for (int ix = 0; ix < voxelsPerAxis; ix++) {
-    float x = ix * voxelSize;
-    for (int iz = 0; iz < voxelsPerAxis; iz++) {
-        float z = iz * voxelSize;
-        
-        // Compute the terrain height at this (x, z) location.
-        float noiseHeight = terrainGen.getY(x, z); // returns height in world units
-        
-        // Compute number of voxels in y-direction based on noise height
-        
-        // Precompute the color for this column once
-        glm::vec4 color = getMountainColor(noiseHeight, mountainStops);
-
-        
-        
-        // Insert voxels for each y-level
-
-            glm::vec3 pos(x, noiseHeight, z);
-            glm::vec3 pos1(x, noiseHeight-1, z);
-            glm::vec3 pos2(x, noiseHeight-2, z);
-            glm::vec3 pos3(x,noiseHeight-3,z);
-            octree.Insert(pos, color);
-            octree.Insert(pos1, color);
-            octree.Insert(pos2, color);
-            octree.Insert(pos3,color);
-        
-    }
-}
-
-
-
     glm::vec3 minBound = glm::vec3(0, 0, 0);
     glm::vec3 maxBound = glm::vec3(octreeSize, octreeSize, octreeSize);
 
@@ -306,26 +339,90 @@ for (int ix = 0; ix < voxelsPerAxis; ix++) {
     glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, SCR_WIDTH, SCR_HEIGHT);
     glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
-    GLuint ssbo;
+#ifdef OCTREE_COMPACT_NODES
+    // The compact layout is derived from the whole tree, so it is uploaded
+    // once and edits don't show up.
+    GLuint ssbo, colorSsbo;
     glGenBuffers(1, &ssbo);
+    glGenBuffers(1, &colorSsbo);
+    CompactOctree compactOctree(octree);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, m_nodes.size() * sizeof(FlattenedNode), m_nodes.data(), GL_STATIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, compactOctree.Nodes().size() * sizeof(CompactNode), compactOctree.Nodes().data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, colorSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, compactOctree.Colors().size() * sizeof(uint32_t), compactOctree.Colors().data(), GL_STATIC_DRAW);
+#else
+    // From here on the writer thread below owns the octree; the render
+    // thread only uploads the snapshots it publishes.
+    OctreeUploader uploader;
+    uploader.Upload(octree.Publish());
+    GLuint ssbo = uploader.NodeBuffer();
+    GLuint colorSsbo = uploader.ColorBuffer();
+#endif
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo);
-// Query the size of the SSBO
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, colorSsbo);
+// Query the size of the SSBOs
 GLint ssboSize = 0;
+GLint colorSsboSize = 0;
 glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
 glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &ssboSize);
-std::cout << "SSBO size: " << ssboSize << " bytes" << std::endl;
+glBindBuffer(GL_SHADER_STORAGE_BUFFER, colorSsbo);
+glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &colorSsboSize);
+std::cout << "SSBO size: " << ssboSize << " bytes (+ " << colorSsboSize << " bytes of colors)" << std::endl;
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+#ifndef OCTREE_COMPACT_NODES
+    // Holding E carves a ball out where the crosshair meets the terrain. The
+    // carve runs on a writer thread that publishes a snapshot afterwards, so
+    // frames keep rendering the last published tree while it works. A
+    // request made while a carve is running replaces any still waiting.
+    std::mutex carveMutex;
+    std::condition_variable carveReady;
+    bool carvePending = false;
+    bool writerDone = false;
+    glm::vec3 carveOrigin(0.0f), carveDirection(0.0f);
+    std::thread writer([&] {
+        std::unique_lock<std::mutex> lock(carveMutex);
+        while (true) {
+            carveReady.wait(lock, [&] { return carvePending || writerDone; });
+            if (writerDone)
+                return;
+            glm::vec3 point = carveOrigin;
+            glm::vec3 step = carveDirection * (voxelSize * 0.5f);
+            carvePending = false;
+            lock.unlock();
+            for (int i = 0; i < 4096; i++, point += step) {
+                if (glm::any(glm::lessThan(point, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(point, glm::vec3(octreeSize))))
+                    continue;
+                if (octree.Lookup(glm::ivec3(point))) {
+                    octree.Combine(CsgShape::Sphere(point, voxelSize * 3.0f), CsgOp::Subtract);
+                    octree.Publish();
+                    break;
+                }
+            }
+            lock.lock();
+        }
+    });
+#endif
+
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         processInput(window);
+#ifndef OCTREE_COMPACT_NODES
+        if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
+            std::lock_guard<std::mutex> lock(carveMutex);
+            carveOrigin = cameraPos;
+            carveDirection = cameraFront;
+            carvePending = true;
+            carveReady.notify_one();
+        }
+        // Only pages that changed since the last uploaded snapshot are sent.
+        uploader.Upload(octree.Snapshot());
+#endif
 
         computeShader.use();
         float cycleDuration = 10.0f; // seconds
@@ -341,6 +438,7 @@ std::cout << "SSBO size: " << ssboSize << " bytes" << std::endl;
         computeShader.setFloat("timeOfDay", timeOfDay);
 
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, colorSsbo);
         computeShader.dispatch((SCR_WIDTH + 15) / 16, (SCR_HEIGHT + 15) / 16, 1);
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
@@ -362,6 +460,14 @@ std::cout << fps << std::endl;
         glfwPollEvents();
     }
 
+#ifndef OCTREE_COMPACT_NODES
+    {
+        std::lock_guard<std::mutex> lock(carveMutex);
+        writerDone = true;
+    }
+    carveReady.notify_one();
+    writer.join();
+#endif
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwTerminate();
@@ -3,16 +3,67 @@
 layout(local_size_x = 16, local_size_y = 16) in;
 layout(rgba32f, binding = 0) uniform image2D resultImage;
 
+// Packed RGBA8 color per node, indexed like the node buffer.
+layout(std430, binding = 2) buffer ColorBuffer {
+    uint colors[];
+};
+
+vec4 nodeColor(int index) {
+    return unpackUnorm4x8(colors[index]);
+}
+
+#ifdef COMPACT_NODES
+// Children of a node are stored contiguously from childBase, one per set bit
+// of the valid mask (masks: bits 0-7 valid, bits 8-15 leaf, bit 16 set on a
+// root that is a leaf).
+struct CompactNode {
+    uint childBase;
+    uint masks;
+};
+
+layout(std430, binding = 1) buffer NodeBuffer {
+    CompactNode nodes[];
+};
+
+// A node without children may be a leaf or an empty interior node, so
+// leafness comes from the parent's leaf mask.
+bool rootIsLeaf() {
+    return (nodes[0].masks & 0x10000u) != 0u;
+}
+
+bool childIsLeaf(int index, int child, int childIndex) {
+    return (nodes[index].masks & (1u << (8 + child))) != 0u;
+}
+
+int nodeChild(int index, int child) {
+    uint valid = nodes[index].masks & 0xFFu;
+    if ((valid & (1u << child)) == 0u)
+        return -1;
+    return int(nodes[index].childBase) + bitCount(valid & ((1u << child) - 1u));
+}
+#else
 struct FlattenedNode {
     bool IsLeaf;
     int childIndices[8];
-    vec4 color;
 };
 
 layout(std430, binding = 1) buffer NodeBuffer {
     FlattenedNode nodes[];
 };
 
+bool rootIsLeaf() {
+    return nodes[0].IsLeaf;
+}
+
+bool childIsLeaf(int index, int child, int childIndex) {
+    return nodes[childIndex].IsLeaf;
+}
+
+int nodeChild(int index, int child) {
+    return nodes[index].childIndices[child];
+}
+#endif
+
 uniform vec2 iResolution;
 uniform mat4 viewMatrix;
 uniform vec3 cameraPos;
@@ -30,6 +81,7 @@ struct StackEntry {
     vec3 nodeMin;
     vec3 nodeMax;
     float tEnter;
+    bool isLeaf;
 };
 
 // Improved AABB intersection that uses the precomputed inverse ray direction.
@@ -64,7 +116,7 @@ vec4 traverseOctree(vec3 ro, vec3 rd) {
     // Initialize a fixed-size stack for iterative traversal.
     StackEntry stack[MAX_STACK_SIZE];
     int stackSize = 0;
-    stack[stackSize++] = StackEntry(0, minBound, maxBound, tEnterRoot);
+    stack[stackSize++] = StackEntry(0, minBound, maxBound, tEnterRoot, rootIsLeaf());
     
     float bestT = MAX_DIST;
     vec4 hitColor = vec4(0.0);
@@ -87,7 +139,7 @@ vec4 traverseOctree(vec3 ro, vec3 rd) {
         if (entry.tEnter > bestT)
             continue;
         
-        FlattenedNode node = nodes[entry.nodeIndex];
+        bool isLeaf = entry.isLeaf;
 
         // Compute the node's center, size, and its distance from the camera.
         vec3 nodeCenter = (entry.nodeMin + entry.nodeMax) * 0.5;
@@ -98,7 +150,7 @@ vec4 traverseOctree(vec3 ro, vec3 rd) {
         float lodMetric = nodeSize / max(distance, 0.001);
         
         // If the node is a leaf, or if the LOD metric is low enough, treat this node as a final hit.
-        if (node.IsLeaf || (!node.IsLeaf && lodMetric < lodThreshold)) {
+        if (isLeaf || (!isLeaf && lodMetric < lodThreshold)) {
             float hitT = entry.tEnter;
             vec3 hitPoint = ro + hitT * rd;
             
@@ -123,14 +175,14 @@ vec4 traverseOctree(vec3 ro, vec3 rd) {
             float ambient = 0.3;
             float lighting = clamp(ambient + 0.7 * diffuse, 0.0, 1.0);
             
-            hitColor = vec4(node.color.rgb * lighting, 1.0);
+            hitColor = vec4(nodeColor(entry.nodeIndex).rgb * lighting, 1.0);
             bestT = entry.tEnter;
             break;
         }
         
         // Otherwise, subdivide and traverse children.
         for (int child = 0; child < 8; child++) {
-            int childIndex = node.childIndices[child];
+            int childIndex = nodeChild(entry.nodeIndex, child);
             if (childIndex == -1)
                 continue;
             
@@ -140,7 +192,8 @@ vec4 traverseOctree(vec3 ro, vec3 rd) {
             float tChildEnter, tChildExit;
             if (intersectAABB(ro, rd, invRD, childMin, childMax, tChildEnter, tChildExit)) {
                 if (tChildEnter < bestT && stackSize < MAX_STACK_SIZE)
-                    stack[stackSize++] = StackEntry(childIndex, childMin, childMax, tChildEnter);
+                    stack[stackSize++] = StackEntry(childIndex, childMin, childMax, tChildEnter,
+                                                         childIsLeaf(entry.nodeIndex, child, childIndex));
             }
         }
     }